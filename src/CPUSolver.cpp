@@ -0,0 +1,1631 @@
+#include "CPUSolver.h"
+
+#include <core/TellusimLog.h>
+#include <math/TellusimSimd.h>
+
+/*
+ */
+namespace Mpm {
+
+	/*
+	 */
+	static TS_INLINE Vector3u get_index(const Vector3f &position, const ComputeParameters &parameters, float32_t offset) {
+		Vector3f index = (position - parameters.grid_origin) * parameters.grid_scale + Vector3f(offset);
+		Vector3f max_index = Vector3f(parameters.grid_size - Vector3u(1u));
+		return Vector3u(clamp(floor(index), Vector3f(0.0f), max_index));
+	}
+
+	static TS_INLINE uint32_t get_hash(const Vector3u &index, const Vector3u &grid_size) {
+		return grid_size.x * (grid_size.y * index.z + index.y) + index.x;
+	}
+
+	static TS_INLINE uint32_t get_morton(const Vector3u &index) {
+		uint32_t ret = 0;
+		for(uint32_t i = 0; i < 10; i++) {
+			ret |= ((index.x >> i) & 1u) << (i * 3 + 0);
+			ret |= ((index.y >> i) & 1u) << (i * 3 + 1);
+			ret |= ((index.z >> i) & 1u) << (i * 3 + 2);
+		}
+		return ret;
+	}
+
+	static TS_INLINE Vector3f plane_collision(const Vector4f &plane, const Vector3f &position, const Vector3f &velocity, float32_t radius) {
+		float32_t depth = dot(plane, position) - radius;
+		if(depth < -1e-4f) {
+			Vector3f normal = -Vector3f(plane);
+			Vector3f relative_velocity = -velocity;
+			Vector3f tangent_velocity = relative_velocity - normal * dot(relative_velocity, normal);
+			return normal * (depth * 2.0f) + relative_velocity * 0.08f + tangent_velocity * 0.06f;
+		}
+		return Vector3f(0.0f);
+	}
+
+	static TS_INLINE Vector3f sphere_collision(const Vector3f &position_0, const Vector3f &velocity_0, const Vector3f &position_1, const Vector3f &velocity_1, float32_t radius) {
+		Vector3f direction = position_1 - position_0;
+		float32_t distance = length(direction);
+		float32_t depth = distance - radius - radius;
+		if(depth < -1e-4f && distance > 1e-4f) {
+			Vector3f normal = direction / distance;
+			Vector3f relative_velocity = velocity_1 - velocity_0;
+			Vector3f tangent_velocity = relative_velocity - normal * dot(relative_velocity, normal);
+			return normal * (depth * 1.0f) + (relative_velocity * 0.04f + tangent_velocity * 0.03f) * clamp(1.0f + depth * 2.0f / radius, 0.0f, 1.0f);
+		}
+		return Vector3f(0.0f);
+	}
+
+	static TS_INLINE float32x8_t gather(const float32_t *TS_RESTRICT src, const uint32_t *TS_RESTRICT index) {
+		return float32x8_t(src[index[0]], src[index[1]], src[index[2]], src[index[3]], src[index[4]], src[index[5]], src[index[6]], src[index[7]]);
+	}
+
+	/**
+	 * Neighbor block of eight lanes in the cell-sorted store
+	 */
+	struct NeighborLanes {
+
+		/// lanes of the sorted channel
+		TS_INLINE float32x8_t get(const float32_t *TS_RESTRICT src) const {
+			if(index) return gather(src, index);
+			return float32x8_t(src + offset);
+		}
+
+		const uint32_t *index;			// list indices or nullptr for the contiguous grid range
+		uint32_t offset;
+	};
+
+	/*
+	 */
+	template <class Kernel> static float32_t get_lattice_density(const Kernel &kernel, float32_t mass, float32_t spacing, float32_t support) {
+
+		// kernel sum of a particle inside of a cubic lattice
+		int32_t num = (int32_t)(support / spacing);
+		float32_t density = 0.0f;
+		for(int32_t z = -num; z <= num; z++) {
+			for(int32_t y = -num; y <= num; y++) {
+				for(int32_t x = -num; x <= num; x++) {
+					density += mass * kernel.get(length(Vector3f((float32_t)x, (float32_t)y, (float32_t)z)) * spacing);
+				}
+			}
+		}
+
+		return density;
+	}
+
+	/**
+	 * Neighbor terms of main.comp accumulated eight neighbors at a time
+	 * The incompressible solvers diffuse the relative velocities with the viscosity kernel Laplacian instead of the main.comp viscosity term
+	 */
+	struct NeighborForces {
+
+		NeighborForces(const SpikyKernel &pressure_kernel, const ViscosityKernel &viscosity_kernel, bool laplacian, const Vector3f &velocity, float32_t mass, float32_t density, float32_t pressure, float32_t radius) :
+			pressure_kernel(pressure_kernel), viscosity_kernel(viscosity_kernel), laplacian(laplacian), vx0(velocity.x), vy0(velocity.y), vz0(velocity.z), mass(mass), density(density), pressure(pressure), radius(radius) { }
+
+		/// add neighbor block, lanes with a non-negative mask are skipped
+		/// the delta points from the neighbor to the particle.
+		TS_INLINE void add(const float32x8_t &mask, const float32x8_t &dx, const float32x8_t &dy, const float32x8_t &dz, const float32x8_t &r2, const float32x8_t &r,
+			const float32x8_t &vx, const float32x8_t &vy, const float32x8_t &vz, const float32x8_t &mass_1, const float32x8_t &density_1, const float32x8_t &pressure_1) {
+
+			const float32x8_t zero = float32x8_t(0.0f);
+			const float32x8_t one = float32x8_t(1.0f);
+			const float32x8_t h_8 = float32x8_t(pressure_kernel.h);
+			const float32x8_t epsilon = float32x8_t(1e-4f);
+			const float32x8_t epsilon2 = float32x8_t(1e-12f);
+
+			float32x8_t ir = one / r;
+
+			// calculate impulse
+			float32x8_t depth = r - radius * 2.0f;
+			float32x8_t nx = -dx * ir;
+			float32x8_t ny = -dy * ir;
+			float32x8_t nz = -dz * ir;
+			float32x8_t rvx = vx - vx0;
+			float32x8_t rvy = vy - vy0;
+			float32x8_t rvz = vz - vz0;
+			float32x8_t rvn = rvx * nx + rvy * ny + rvz * nz;
+			float32x8_t friction = clamp(depth * (2.0f / radius) + 1.0f, 0.0f, 1.0f);
+			float32x8_t collision_mask = max(mask, max(depth + epsilon, epsilon - r));
+			impulse_x += select(zero, nx * depth + (rvx * 0.04f + (rvx - nx * rvn) * 0.03f) * friction, collision_mask);
+			impulse_y += select(zero, ny * depth + (rvy * 0.04f + (rvy - ny * rvn) * 0.03f) * friction, collision_mask);
+			impulse_z += select(zero, nz * depth + (rvz * 0.04f + (rvz - nz * rvn) * 0.03f) * friction, collision_mask);
+
+			// pressure and viscosity kernels
+			float32x8_t mass_ratio = mass_1 / mass;
+			float32x8_t w_pressure = pressure_kernel.getGradientShape(r);
+			float32x8_t pressure_scale = mass_ratio * ((pressure_1 + pressure) / (density_1 * (2.0f * density))) * w_pressure * ir;
+			float32x8_t viscosity_scale = (laplacian) ? mass_ratio / density_1 * viscosity_kernel.getLaplacian(r) : mass_ratio * (one / density_1) * viscosity_kernel.getShape(r2, r, ir) * ir;
+			float32x8_t kernel_mask = max(mask, max(r - h_8, epsilon2 - r2));
+			pressure_scale = select(zero, pressure_scale, kernel_mask);
+			viscosity_scale = select(zero, viscosity_scale, kernel_mask);
+			neighbors += select(zero, one, kernel_mask);
+
+			// calculate pressure
+			pressure_x += dx * pressure_scale;
+			pressure_y += dy * pressure_scale;
+			pressure_z += dz * pressure_scale;
+
+			// calculate viscosity
+			if(laplacian) {
+				viscosity_x += rvx * viscosity_scale;
+				viscosity_y += rvy * viscosity_scale;
+				viscosity_z += rvz * viscosity_scale;
+			} else {
+				viscosity_x += dx * viscosity_scale;
+				viscosity_y += dy * viscosity_scale;
+				viscosity_z += dz * viscosity_scale;
+			}
+		}
+
+		const SpikyKernel &pressure_kernel;
+		const ViscosityKernel &viscosity_kernel;
+		bool laplacian;
+
+		float32x8_t vx0, vy0, vz0;
+		float32_t mass, density, pressure, radius;
+
+		float32x8_t impulse_x = float32x8_t(0.0f), impulse_y = float32x8_t(0.0f), impulse_z = float32x8_t(0.0f);
+		float32x8_t pressure_x = float32x8_t(0.0f), pressure_y = float32x8_t(0.0f), pressure_z = float32x8_t(0.0f);
+		float32x8_t viscosity_x = float32x8_t(0.0f), viscosity_y = float32x8_t(0.0f), viscosity_z = float32x8_t(0.0f);
+		float32x8_t neighbors = float32x8_t(0.0f);
+	};
+
+	/*
+	 */
+	template <> TS_INLINE const CubicKernel &CPUSolver::get_kernel<CubicKernel>() const { return cubic_kernel; }
+	template <> TS_INLINE const WendlandKernel &CPUSolver::get_kernel<WendlandKernel>() const { return wendland_kernel; }
+	template <> TS_INLINE const KernelTable<CubicKernel> &CPUSolver::get_kernel<KernelTable<CubicKernel>>() const { return cubic_table; }
+	template <> TS_INLINE const KernelTable<WendlandKernel> &CPUSolver::get_kernel<KernelTable<WendlandKernel>>() const { return wendland_table; }
+
+	template <class Kernel> void CPUSolver::set_kernel() {
+		factors_pass = &CPUSolver::update_factors<Kernel>;
+		errors_pass = &CPUSolver::update_errors<Kernel>;
+		pressures_pass = &CPUSolver::update_pressures<Kernel>;
+	}
+
+	/*
+	 */
+	CPUSolver::CPUSolver() {
+
+	}
+
+	CPUSolver::~CPUSolver() {
+
+	}
+
+	/*
+	 */
+	void CPUSolver::clear() {
+		async = nullptr;
+		size = 0;
+		grid_size = Vector3u(0u);
+		num_cells = 0;
+		num_scenes = 1;
+		scenes.clear();
+		reorder_scenes.clear();
+		scene_parameters.clear();
+		scene_kernels.clear();
+		particles[0].clear();
+		particles[1].clear();
+		sorted.clear();
+		hashes.clear();
+		indices.clear();
+		ranges.clear();
+		slots.clear();
+		task_stats.clear();
+		resetStats();
+		pressure_stats = PressureStats();
+		rest_density = 0.0f;
+		factors.clear();
+		kappas.clear();
+		kappa_data = nullptr;
+		task_errors.clear();
+		support_kernel = NumKernels;
+		cubic_table.clear();
+		wendland_table.clear();
+		lists_valid = false;
+		list_overflow = false;
+		grid_dirty = true;
+		grid_rebuilt = false;
+		num_rebuilds = 0;
+		references.clear();
+		task_motions.clear();
+		max_speed = 0.0f;
+		max_acceleration = 0.0f;
+		substep = 0;
+		time_levels.clear();
+		wake_flags[0].clear();
+		wake_flags[1].clear();
+		levels.clear();
+		level_data = nullptr;
+		reorder_step = 0;
+		num_reorders = 0;
+		order.clear();
+		reorder_keys.clear();
+		reorder_values.clear();
+		reorder_scratch.clear();
+		reorder_references.clear();
+		list_offsets.clear();
+		list_counts.clear();
+		list_indices.clear();
+		list_distances.clear();
+		task_lists.clear();
+		list_data = nullptr;
+	}
+
+	/*
+	 */
+	bool CPUSolver::create(Async &a, uint32_t s, const Vector3u &g, uint32_t n) {
+
+		clear();
+
+		// check parameters
+		if(s == 0) {
+			TS_LOG(Error, "CPUSolver::create(): invalid size\n");
+			return false;
+		}
+		if(s >= (1u << 23)) {
+			TS_LOGF(Error, "CPUSolver::create(): %u particles exceed the float lane index range\n", s);
+			return false;
+		}
+		if(g.x == 0 || g.y == 0 || g.z == 0) {
+			TS_LOGF(Error, "CPUSolver::create(): invalid grid size %ux%ux%u\n", g.x, g.y, g.z);
+			return false;
+		}
+		if(n == 0 || (uint64_t)g.x * g.y * g.z * n >= (1ull << 31)) {
+			TS_LOGF(Error, "CPUSolver::create(): invalid number of scenes %u\n", n);
+			return false;
+		}
+		if(!a.isInitialized() && !a.init()) {
+			TS_LOG(Error, "CPUSolver::create(): can't initialize async\n");
+			return false;
+		}
+
+		async = &a;
+		size = s;
+		grid_size = g;
+		num_cells = grid_size.x * grid_size.y * grid_size.z;
+		num_scenes = n;
+
+		// particle state
+		if(!particles[0].create(size)) return false;
+		if(!particles[1].create(size)) return false;
+		if(!sorted.create(size)) return false;
+
+		// spatial grid
+		hashes.resize(size, 0u);
+		indices.resize(size, 0u);
+		ranges.resize(num_cells * num_scenes * 2, 0u);
+		slots.resize(size, 0u);
+		references.resize(size);
+		order.resize(size, 0u);
+
+		// scenes are stacked in consecutive blocks of cells
+		if(num_scenes > 1) {
+			scenes.resize(size, 0u);
+			scene_parameters.resize(num_scenes, PhysicsParameters());
+			scene_kernels.resize(num_scenes);
+		}
+
+		return true;
+	}
+
+	/*
+	 */
+	void CPUSolver::setParticles(const ParticleStore &store, const uint32_t *scene_ids) {
+		TS_ASSERT(store.getSize() == size);
+		TS_ASSERT((num_scenes == 1 || scene_ids) && "CPUSolver::setParticles(): scenes are required");
+		particles[0].copy(store);
+		if(num_scenes > 1) memcpy(scenes.get(), scene_ids, sizeof(uint32_t) * size);
+		particles[0].fill(ParticleStore::ChannelDensity, 0.0f);
+		particles[0].fill(ParticleStore::ChannelPressure, 0.0f);
+
+		// the grid is built by the first simulation pass
+		for(uint32_t &range : ranges) range = 0;
+		for(uint32_t i = 0; i < size; i++) slots[i] = i;
+		for(uint32_t i = 0; i < size; i++) order[i] = i;
+		reorder_step = 0;
+		list_overflow = false;
+		lists_valid = false;
+		grid_dirty = true;
+		rest_density = 0.0f;
+
+		// particles start at the finest level
+		if(num_levels > 1) setTimeLevels(num_levels, level_cfl);
+	}
+
+	void CPUSolver::setSceneParameters(const PhysicsParameters *p) {
+		if(num_scenes == 1) return;
+		memcpy(scene_parameters.get(), p, sizeof(PhysicsParameters) * num_scenes);
+
+		// lists of the previous kernel lengths can miss neighbors
+		lists_valid = false;
+	}
+
+	void CPUSolver::setInteraction(const Vector4f &i) {
+		interaction = i;
+	}
+
+	/*
+	 */
+	void CPUSolver::dispatch(const ComputeParameters &p) {
+
+		TS_ASSERT(p.grid_size == grid_size);
+
+		// lists of the previous kernel lengths can miss neighbors
+		if(p.physics.density_length != parameters.physics.density_length || p.physics.smoothing_length != parameters.physics.smoothing_length) lists_valid = false;
+		parameters = p;
+
+		// kernel constants of the scene physics
+		if(pressure_solver != PressureEOS && parameters.physics.kernel != support_kernel) update_support_kernel();
+		kernels = SceneKernels(parameters.physics);
+		for(uint32_t i = 0; i < scene_kernels.size(); i++) {
+			scene_kernels[i] = SceneKernels(scene_parameters[i]);
+		}
+
+		// Morton order of the particles built by the previous step
+		if(reorder_interval && !grid_dirty && ++reorder_step >= reorder_interval) {
+			update_order();
+			reorder_step = 0;
+		}
+
+		// substeps of the finest level, every particle is updated by the first one
+		max_speed = 0.0f;
+		max_acceleration = 0.0f;
+		if(has_time_levels()) {
+			uint32_t num_substeps = 1u << (num_levels - 1);
+			parameters.ifps = p.ifps / (float32_t)num_substeps;
+			for(substep = 0; substep < num_substeps; substep++) {
+				dispatch_step();
+			}
+			substep = 0;
+		} else {
+			dispatch_step();
+		}
+	}
+
+	void CPUSolver::dispatch_step() {
+
+		// neighbor lists shared by both passes
+		// with the skin the lists are kept until the next grid rebuild
+		if(!use_lists || list_overflow) lists_valid = false;
+		else if(skin == 0.0f || !lists_valid || grid_rebuilt) create_lists();
+
+		if(pressure_solver != PressureEOS) {
+			dispatch_pressure();
+		} else {
+
+			// pressureDensity.comp
+			dispatch_pass(&CPUSolver::update_density, &density_stats);
+
+			// main.comp
+			dispatch_pass(&CPUSolver::update_simulation, &force_stats);
+		}
+
+		// maximums of the integration tasks
+		TaskMotion motion;
+		for(const TaskMotion &task : task_motions) {
+			motion.displacement = max(motion.displacement, task.displacement);
+			motion.speed = max(motion.speed, task.speed);
+			motion.acceleration = max(motion.acceleration, task.acceleration);
+			motion.updates += task.updates;
+		}
+		num_updates += motion.updates;
+		max_speed = max(max_speed, Tellusim::sqrt(motion.speed));
+		max_acceleration = max(max_acceleration, Tellusim::sqrt(motion.acceleration) / parameters.ifps);
+
+		// spatial grid
+		// with the skin the grid is rebuilt when a particle moved further than half of the skin
+		grid_rebuilt = (skin == 0.0f || grid_dirty);
+		if(!grid_rebuilt) grid_rebuilt = (motion.displacement > skin * skin * 0.25f);
+		if(grid_rebuilt) {
+			update_grid();
+			grid_dirty = false;
+			num_rebuilds++;
+		}
+		dispatch_pass(&CPUSolver::update_sorted);
+
+		// swap buffers
+		particles[0].swap(particles[1]);
+	}
+
+	/*
+	 */
+	void CPUSolver::dispatch_pass(void (CPUSolver::*func)(uint32_t, uint32_t), NeighborStats *stats) {
+
+		// split particles into several chunks per thread for load balancing
+		// deterministic tasks don't depend on the number of threads
+		uint32_t num_tasks = async->getNumThreads() * 4;
+		uint32_t step = max((size + num_tasks - 1) / num_tasks, 256u);
+		if(deterministic) step = 1024;
+
+		// tasks write their statistics into separate slots
+		task_step = step;
+		task_stats.resize((size + step - 1) / step);
+		for(NeighborStats &task : task_stats) task = NeighborStats();
+		task_motions.resize(task_stats.size(), TaskMotion());
+		task_errors.resize(task_stats.size(), 0.0f);
+		if(use_lists && task_lists.size() != task_stats.size()) task_lists.resize(task_stats.size());
+
+		Array<Async::Task> tasks;
+		for(uint32_t begin = 0; begin < size; begin += step) {
+			tasks.append(async->run(makeClassFunction(this, func, begin, min(begin + step, size))));
+		}
+		async->wait(tasks);
+
+		if(stats) {
+			for(const NeighborStats &task : task_stats) {
+				stats->candidates += task.candidates;
+				stats->neighbors += task.neighbors;
+			}
+		}
+	}
+
+	/*
+	 */
+	void CPUSolver::setNeighborLists(bool enabled, bool distances, size_t max_bytes) {
+		use_lists = enabled;
+		cache_distances = distances;
+		list_budget = max_bytes;
+		lists_valid = false;
+		list_overflow = false;
+		if(!use_lists) {
+			list_offsets.release();
+			list_counts.release();
+			list_indices.release();
+			list_distances.release();
+			task_lists.release();
+			list_data = nullptr;
+		}
+	}
+
+	size_t CPUSolver::getNeighborListBytes() const {
+		if(!lists_valid) return 0;
+		return list_offsets.bytes() + list_counts.bytes() + list_indices.bytes() + list_distances.bytes();
+	}
+
+	/*
+	 */
+	void CPUSolver::setPressureSolver(PressureSolver solver, const PressureParameters &p) {
+		pressure_solver = solver;
+		pressure_parameters = p;
+		pressure_stats = PressureStats();
+		rest_density = 0.0f;
+		if(pressure_solver == PressureEOS) {
+			factors.release();
+			kappas.release();
+			kappa_data = nullptr;
+		}
+
+		// support kernel of the solver passes is selected by the next dispatch
+		support_kernel = NumKernels;
+	}
+
+	void CPUSolver::update_support_kernel() {
+
+		// derived rest densities depend on the kernel
+		support_kernel = (parameters.physics.kernel == KernelWendland) ? KernelWendland : KernelCubic;
+		rest_density = 0.0f;
+
+		float32_t support = pressure_parameters.support;
+		cubic_kernel = CubicKernel(support);
+		wendland_kernel = WendlandKernel(support);
+		cubic_table.clear();
+		wendland_table.clear();
+		if(support_kernel == KernelWendland) {
+			if(pressure_parameters.tabulated) {
+				wendland_table.create(support);
+				set_kernel<KernelTable<WendlandKernel>>();
+			} else {
+				set_kernel<WendlandKernel>();
+			}
+		} else {
+			if(pressure_parameters.tabulated) {
+				cubic_table.create(support);
+				set_kernel<KernelTable<CubicKernel>>();
+			} else {
+				set_kernel<CubicKernel>();
+			}
+		}
+	}
+
+	/*
+	 */
+	void CPUSolver::setTimeLevels(uint32_t num, float32_t cfl) {
+		num_levels = clamp(num, 1u, (uint32_t)MaxTimeLevels);
+		level_cfl = max(cfl, 1e-3f);
+		substep = 0;
+		if(num_levels == 1) {
+			time_levels.release();
+			wake_flags[0].release();
+			wake_flags[1].release();
+			levels.release();
+			level_data = nullptr;
+			return;
+		}
+
+		// levels in the cell order are padded for the aligned loads of the grid ranges
+		time_levels.resize(size, TimeLevel());
+		wake_flags[0].resize(size, Atomici32(0));
+		wake_flags[1].resize(size, Atomici32(0));
+		levels.resize(size + ParticleStore::Width * 2, 0.0f);
+		size_t address = (size_t)levels.get();
+		level_data = (float32_t*)((address + ParticleStore::Alignment - 1) & ~(size_t)(ParticleStore::Alignment - 1));
+	}
+
+	void CPUSolver::getTimeLevels(uint32_t *counts) const {
+		for(uint32_t i = 0; i < num_levels; i++) counts[i] = 0;
+		if(num_levels == 1) counts[0] = size;
+		else for(const TimeLevel &level : time_levels) counts[level.level]++;
+	}
+
+	/*
+	 */
+	void CPUSolver::setSkin(float32_t s) {
+		skin = max(s, 0.0f);
+		grid_dirty = true;
+	}
+
+	/*
+	 */
+	uint64_t CPUSolver::getStateHash() const {
+
+		// loaded particle positions in the simulation order
+		Array<uint32_t> inverse(size);
+		for(uint32_t i = 0; i < size; i++) inverse[order[i]] = i;
+
+		return particles[0].getHash(inverse.get());
+	}
+
+	/*
+	 */
+	void CPUSolver::resetStats() {
+		density_stats = NeighborStats();
+		force_stats = NeighborStats();
+		pressure_totals = PressureStats();
+		num_pressure_steps = 0;
+		num_rebuilds = 0;
+		num_reorders = 0;
+		num_updates = 0;
+	}
+
+	/*
+	 */
+	uint32_t CPUSolver::get_ranges(uint32_t global_id, const Vector3f &position, uint32_t *range_begin, uint32_t *range_end) const {
+
+		uint32_t num_ranges = 0;
+		uint32_t scene_cells = get_scene_cells(global_id);
+		Vector3u index = get_index(position, parameters, parameters.stencil_offset);
+
+		// the grid is bounded, cells past the last one are skipped
+		uint32_t last_x = min(index.x + parameters.stencil_size, grid_size.x) - 1;
+		for(uint32_t z = 0; z < parameters.stencil_size; z++) {
+			uint32_t Z = index.z + z;
+			if(Z >= grid_size.z) break;
+			for(uint32_t y = 0; y < parameters.stencil_size; y++) {
+				uint32_t Y = index.y + y;
+				if(Y >= grid_size.y) break;
+				uint32_t row = get_hash(Vector3u(0u, Y, Z), grid_size) + scene_cells;
+				range_begin[num_ranges] = ranges[(row + index.x) * 2 + 0];
+				range_end[num_ranges] = ranges[(row + last_x) * 2 + 1];
+				num_ranges += (range_begin[num_ranges] < range_end[num_ranges]);
+			}
+		}
+
+		return num_ranges;
+	}
+
+	template <class Func> TS_INLINE void CPUSolver::for_neighbors(uint32_t global_id, const Vector3f &position, NeighborStats &stats, Func &&func) const {
+
+		const float32x8_t lanes = float32x8_t(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		const float32x8_t half = float32x8_t(0.5f);
+
+		const float32_t *TS_RESTRICT sx = sorted.get(ParticleStore::ChannelX);
+		const float32_t *TS_RESTRICT sy = sorted.get(ParticleStore::ChannelY);
+		const float32_t *TS_RESTRICT sz = sorted.get(ParticleStore::ChannelZ);
+
+		float32x8_t x0 = float32x8_t(position.x);
+		float32x8_t y0 = float32x8_t(position.y);
+		float32x8_t z0 = float32x8_t(position.z);
+
+		if(lists_valid) {
+
+			// iterate the neighbor list, lanes past the neighbor count are masked
+			uint32_t offset = list_offsets[global_id];
+			uint32_t count = list_counts[global_id];
+			float32x8_t last = float32x8_t((float32_t)count - 0.5f);
+			stats.candidates += count;
+			for(uint32_t i = 0; i < count; i += ParticleStore::Width) {
+				NeighborLanes neighbor = { list_indices.get() + offset + i, 0 };
+				float32x8_t dx = x0 - neighbor.get(sx);
+				float32x8_t dy = y0 - neighbor.get(sy);
+				float32x8_t dz = z0 - neighbor.get(sz);
+				func(lanes + (float32_t)i - last, dx, dy, dz, dx * dx + dy * dy + dz * dz, neighbor);
+			}
+
+		} else {
+
+			float32x8_t self = float32x8_t((float32_t)slots[global_id]);
+
+			uint32_t range_begin[9];
+			uint32_t range_end[9];
+			uint32_t num_ranges = get_ranges(global_id, position, range_begin, range_end);
+			for(uint32_t r = 0; r < num_ranges; r++) {
+
+				// blocks start at the aligned index, lanes outside of the range and the particle itself are masked
+				float32x8_t first = float32x8_t((float32_t)range_begin[r] - 0.5f);
+				float32x8_t last = float32x8_t((float32_t)range_end[r] - 0.5f);
+				stats.candidates += range_end[r] - range_begin[r];
+				for(uint32_t i = range_begin[r] & ~(uint32_t)(ParticleStore::Width - 1); i < range_end[r]; i += ParticleStore::Width) {
+					float32x8_t lane = lanes + (float32_t)i;
+					NeighborLanes neighbor = { nullptr, i };
+					float32x8_t dx = x0 - float32x8_t(sx + i);
+					float32x8_t dy = y0 - float32x8_t(sy + i);
+					float32x8_t dz = z0 - float32x8_t(sz + i);
+					func(max(max(first - lane, lane - last), half - abs(lane - self)), dx, dy, dz, dx * dx + dy * dy + dz * dz, neighbor);
+				}
+			}
+		}
+	}
+
+	/*
+	 */
+	void CPUSolver::create_lists() {
+
+		lists_valid = false;
+		list_offsets.resize(size);
+		list_counts.resize(size);
+
+		// tasks append to their own lists
+		dispatch_pass(&CPUSolver::update_lists);
+
+		// fall back to the grid search when any task is over the budget
+		uint32_t num_entries = 0;
+		for(TaskList &list : task_lists) {
+			if(list.overflow) {
+				TS_LOGF(Warning, "CPUSolver::create_lists(): neighbor lists exceed %llu MB budget\n", (unsigned long long)(list_budget >> 20));
+				list_overflow = true;
+				return;
+			}
+			list.offset = num_entries;
+			num_entries += list.indices.size();
+		}
+
+		// concatenate task lists
+		list_indices.resize(num_entries);
+		list_data = nullptr;
+		if(cache_distances && skin == 0.0f) {
+			list_distances.resize(num_entries * 4 + ParticleStore::Width);
+			size_t address = (size_t)list_distances.get();
+			list_data = (float32_t*)((address + ParticleStore::Alignment - 1) & ~(size_t)(ParticleStore::Alignment - 1));
+		}
+		dispatch_pass(&CPUSolver::update_offsets);
+
+		lists_valid = true;
+	}
+
+	void CPUSolver::update_lists(uint32_t begin, uint32_t end) {
+
+		// the lists cover the largest kernel support of the scenes and the skin
+		const PhysicsParameters *physics = (num_scenes > 1) ? scene_parameters.get() : &parameters.physics;
+		float32_t h = parameters.radius * 2.0f;
+		for(uint32_t i = 0; i < num_scenes; i++) h = max(h, max(physics[i].density_length, physics[i].smoothing_length));
+		h += skin;
+		const bool cache_distances = (this->cache_distances && skin == 0.0f);
+
+		const float32x8_t lanes = float32x8_t(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		const float32x8_t zero = float32x8_t(0.0f);
+		const float32x8_t half = float32x8_t(0.5f);
+		const float32x8_t h2_8 = float32x8_t(h * h);
+
+		const ParticleStore &src = particles[0];
+		const float32_t *TS_RESTRICT sx = sorted.get(ParticleStore::ChannelX);
+		const float32_t *TS_RESTRICT sy = sorted.get(ParticleStore::ChannelY);
+		const float32_t *TS_RESTRICT sz = sorted.get(ParticleStore::ChannelZ);
+
+		TaskList &list = task_lists[begin / task_step];
+		list.overflow = false;
+
+		// share of the memory budget
+		size_t entry_bytes = sizeof(uint32_t) + (cache_distances ? sizeof(float32_t) * 4 : 0);
+		size_t max_entries = list_budget / entry_bytes * (end - begin) / size;
+
+		uint32_t range_begin[9];
+		uint32_t range_end[9];
+
+		uint32_t num_entries = 0;
+		for(uint32_t global_id = begin; global_id < end; global_id++) {
+
+			Vector3f position = src.getPosition(global_id);
+			float32x8_t x0 = float32x8_t(position.x);
+			float32x8_t y0 = float32x8_t(position.y);
+			float32x8_t z0 = float32x8_t(position.z);
+			uint32_t slot = slots[global_id];
+			float32x8_t self = float32x8_t((float32_t)slot);
+
+			// reserve all candidates and the padding
+			uint32_t num_candidates = ParticleStore::Width;
+			uint32_t num_ranges = get_ranges(global_id, position, range_begin, range_end);
+			for(uint32_t r = 0; r < num_ranges; r++) {
+				num_candidates += range_end[r] - range_begin[r];
+			}
+			list.indices.resize(num_entries + num_candidates, true);
+			if(cache_distances) list.distances.resize((num_entries + num_candidates) * 4, true);
+			uint32_t *TS_RESTRICT indices = list.indices.get();
+			float32_t *TS_RESTRICT distances = list.distances.get();
+
+			// lists start at the Width boundary
+			uint32_t offset = num_entries;
+
+			for(uint32_t r = 0; r < num_ranges; r++) {
+				float32x8_t first = float32x8_t((float32_t)range_begin[r] - 0.5f);
+				float32x8_t last = float32x8_t((float32_t)range_end[r] - 0.5f);
+				for(uint32_t i = range_begin[r] & ~(uint32_t)(ParticleStore::Width - 1); i < range_end[r]; i += ParticleStore::Width) {
+					float32x8_t lane = lanes + (float32_t)i;
+					float32x8_t dx = x0 - float32x8_t(sx + i);
+					float32x8_t dy = y0 - float32x8_t(sy + i);
+					float32x8_t dz = z0 - float32x8_t(sz + i);
+					float32x8_t r2 = dx * dx + dy * dy + dz * dz;
+					float32x8_t mask = max(max(first - lane, lane - last), max(r2 - h2_8, half - abs(lane - self)));
+
+					// append neighbors inside the support
+					for(uint32_t bits = (mask < zero), j = i; bits; bits >>= 1, j++) {
+						if((bits & 1) == 0) continue;
+						indices[num_entries] = j;
+						if(cache_distances) {
+							float32_t *TS_RESTRICT data = distances + (num_entries & ~(uint32_t)(ParticleStore::Width - 1)) * 4 + (num_entries & (ParticleStore::Width - 1));
+							Vector3f delta = position - Vector3f(sx[j], sy[j], sz[j]);
+							data[ParticleStore::Width * 0] = delta.x;
+							data[ParticleStore::Width * 1] = delta.y;
+							data[ParticleStore::Width * 2] = delta.z;
+							data[ParticleStore::Width * 3] = length(delta);
+						}
+						num_entries++;
+					}
+				}
+			}
+
+			list_offsets[global_id] = offset;
+			list_counts[global_id] = num_entries - offset;
+
+			// pad the list with the particle itself, padding lanes are masked by the count
+			while(num_entries & (ParticleStore::Width - 1)) {
+				indices[num_entries] = slot;
+				if(cache_distances) {
+					float32_t *TS_RESTRICT data = distances + (num_entries & ~(uint32_t)(ParticleStore::Width - 1)) * 4 + (num_entries & (ParticleStore::Width - 1));
+					data[ParticleStore::Width * 0] = 0.0f;
+					data[ParticleStore::Width * 1] = 0.0f;
+					data[ParticleStore::Width * 2] = 0.0f;
+					data[ParticleStore::Width * 3] = 0.0f;
+				}
+				num_entries++;
+			}
+
+			if(num_entries > max_entries) {
+				list.overflow = true;
+				break;
+			}
+		}
+
+		list.indices.resize(num_entries);
+		list.distances.resize(cache_distances ? num_entries * 4 : 0);
+	}
+
+	void CPUSolver::update_offsets(uint32_t begin, uint32_t end) {
+		const TaskList &list = task_lists[begin / task_step];
+		for(uint32_t i = begin; i < end; i++) {
+			list_offsets[i] += list.offset;
+		}
+		memcpy(list_indices.get() + list.offset, list.indices.get(), list.indices.bytes());
+		if(list_data) memcpy(list_data + list.offset * 4, list.distances.get(), list.distances.bytes());
+	}
+
+	/*
+	 */
+	void CPUSolver::update_density(uint32_t begin, uint32_t end) {
+
+		const float32x8_t lanes = float32x8_t(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		const float32x8_t zero = float32x8_t(0.0f);
+		const float32x8_t one = float32x8_t(1.0f);
+		const float32x8_t half = float32x8_t(0.5f);
+
+		ParticleStore &src = particles[0];
+		const float32_t *TS_RESTRICT px = src.get(ParticleStore::ChannelX);
+		const float32_t *TS_RESTRICT py = src.get(ParticleStore::ChannelY);
+		const float32_t *TS_RESTRICT pz = src.get(ParticleStore::ChannelZ);
+		const float32_t *TS_RESTRICT masses = src.get(ParticleStore::ChannelMass);
+		float32_t *TS_RESTRICT densities = src.get(ParticleStore::ChannelDensity);
+		float32_t *TS_RESTRICT pressures = src.get(ParticleStore::ChannelPressure);
+
+		// neighbors are read from the cell-sorted copy
+		const float32_t *TS_RESTRICT sx = sorted.get(ParticleStore::ChannelX);
+		const float32_t *TS_RESTRICT sy = sorted.get(ParticleStore::ChannelY);
+		const float32_t *TS_RESTRICT sz = sorted.get(ParticleStore::ChannelZ);
+		const float32_t *TS_RESTRICT smasses = sorted.get(ParticleStore::ChannelMass);
+		float32_t *TS_RESTRICT sdensities = sorted.get(ParticleStore::ChannelDensity);
+		float32_t *TS_RESTRICT spressures = sorted.get(ParticleStore::ChannelPressure);
+
+		uint32_t range_begin[9];
+		uint32_t range_end[9];
+		NeighborStats &stats = task_stats[begin / task_step];
+
+		for(uint32_t global_id = begin; global_id < end; global_id++) {
+			if(!is_active(global_id)) continue;
+
+			// kernel of the particle scene
+			const PhysicsParameters &physics = get_physics(global_id);
+			const Poly6Kernel &kernel = get_kernels(global_id).density;
+			const float32x8_t h2_8 = float32x8_t(kernel.h2);
+
+			float32x8_t x0 = float32x8_t(px[global_id]);
+			float32x8_t y0 = float32x8_t(py[global_id]);
+			float32x8_t z0 = float32x8_t(pz[global_id]);
+			float32x8_t density_8 = zero;
+			float32x8_t neighbors_8 = zero;
+
+			if(lists_valid) {
+
+				// the particle itself is not in the list
+				density_8 = select(zero, float32x8_t(masses[global_id] * kernel.getShape(0.0f)), lanes - half);
+				neighbors_8 = select(zero, one, lanes - half);
+				stats.candidates++;
+
+				// iterate the neighbor list, lanes past the neighbor count are masked
+				uint32_t offset = list_offsets[global_id];
+				uint32_t count = list_counts[global_id];
+				float32x8_t last = float32x8_t((float32_t)count - 0.5f);
+				stats.candidates += count;
+				for(uint32_t i = 0; i < count; i += ParticleStore::Width) {
+					const uint32_t *TS_RESTRICT index = list_indices.get() + offset + i;
+
+					float32x8_t r2;
+					if(list_data) {
+						float32x8_t r = float32x8_t(list_data + (offset + i) * 4 + ParticleStore::Width * 3);
+						r2 = r * r;
+					} else {
+						float32x8_t dx = x0 - gather(sx, index);
+						float32x8_t dy = y0 - gather(sy, index);
+						float32x8_t dz = z0 - gather(sz, index);
+						r2 = dx * dx + dy * dy + dz * dz;
+					}
+
+					// calculate density and pressure
+					float32x8_t mask = max(lanes + (float32_t)i - last, r2 - h2_8);
+					density_8 += select(zero, gather(smasses, index) * kernel.getShape(r2), mask);
+					neighbors_8 += select(zero, one, mask);
+				}
+
+			} else {
+
+				uint32_t num_ranges = get_ranges(global_id, Vector3f(px[global_id], py[global_id], pz[global_id]), range_begin, range_end);
+				for(uint32_t r = 0; r < num_ranges; r++) {
+
+					// blocks start at the aligned index, lanes outside of the range are masked
+					float32x8_t first = float32x8_t((float32_t)range_begin[r] - 0.5f);
+					float32x8_t last = float32x8_t((float32_t)range_end[r] - 0.5f);
+					stats.candidates += range_end[r] - range_begin[r];
+					for(uint32_t i = range_begin[r] & ~(uint32_t)(ParticleStore::Width - 1); i < range_end[r]; i += ParticleStore::Width) {
+						float32x8_t lane = lanes + (float32_t)i;
+
+						// calculate density and pressure
+						float32x8_t dx = x0 - float32x8_t(sx + i);
+						float32x8_t dy = y0 - float32x8_t(sy + i);
+						float32x8_t dz = z0 - float32x8_t(sz + i);
+						float32x8_t r2 = dx * dx + dy * dy + dz * dz;
+						float32x8_t mask = max(max(first - lane, lane - last), r2 - h2_8);
+						density_8 += select(zero, float32x8_t(smasses + i) * kernel.getShape(r2), mask);
+						neighbors_8 += select(zero, one, mask);
+					}
+				}
+			}
+			stats.neighbors += (uint64_t)neighbors_8.sum();
+
+			float32_t density = density_8.sum() * kernel.scale;
+			densities[global_id] = max(density, physics.rest_density);
+			pressures[global_id] = physics.stiffness * (density - physics.rest_density);
+
+			uint32_t slot = slots[global_id];
+			sdensities[slot] = densities[global_id];
+			spressures[slot] = pressures[global_id];
+		}
+	}
+
+	/*
+	 */
+	void CPUSolver::update_simulation(uint32_t begin, uint32_t end) {
+
+		const float32_t ifps = parameters.ifps;
+		const float32_t radius = parameters.radius;
+
+		const bool multirate = has_time_levels();
+
+		const float32x8_t lanes = float32x8_t(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		const float32x8_t zero = float32x8_t(0.0f);
+		const float32x8_t half = float32x8_t(0.5f);
+		const float32x8_t max_level_8 = float32x8_t((float32_t)MaxTimeLevels);
+
+		const ParticleStore &src = particles[0];
+		const float32_t *TS_RESTRICT masses = src.get(ParticleStore::ChannelMass);
+		const float32_t *TS_RESTRICT densities = src.get(ParticleStore::ChannelDensity);
+		const float32_t *TS_RESTRICT pressures = src.get(ParticleStore::ChannelPressure);
+
+		// neighbors are read from the cell-sorted copy
+		const float32_t *TS_RESTRICT sx = sorted.get(ParticleStore::ChannelX);
+		const float32_t *TS_RESTRICT sy = sorted.get(ParticleStore::ChannelY);
+		const float32_t *TS_RESTRICT sz = sorted.get(ParticleStore::ChannelZ);
+		const float32_t *TS_RESTRICT svx = sorted.get(ParticleStore::ChannelVX);
+		const float32_t *TS_RESTRICT svy = sorted.get(ParticleStore::ChannelVY);
+		const float32_t *TS_RESTRICT svz = sorted.get(ParticleStore::ChannelVZ);
+		const float32_t *TS_RESTRICT smasses = sorted.get(ParticleStore::ChannelMass);
+		const float32_t *TS_RESTRICT sdensities = sorted.get(ParticleStore::ChannelDensity);
+		const float32_t *TS_RESTRICT spressures = sorted.get(ParticleStore::ChannelPressure);
+
+		ParticleStore &dest = particles[1];
+
+		uint32_t range_begin[9];
+		uint32_t range_end[9];
+		NeighborStats &stats = task_stats[begin / task_step];
+		TaskMotion &motion = task_motions[begin / task_step];
+
+		for(uint32_t global_id = begin; global_id < end; global_id++) {
+
+			Vector3f position = src.getPosition(global_id);
+			Vector3f velocity = src.getVelocity(global_id);
+
+			// particles between the updates of their level drift with the velocity of the last update
+			if(!is_active(global_id)) {
+				store_particle(global_id, position + velocity * ifps, velocity, motion);
+				continue;
+			}
+			motion.updates++;
+
+			// kernels of the particle scene
+			const PhysicsParameters &physics = get_physics(global_id);
+			const SpikyKernel &pressure_kernel = get_kernels(global_id).pressure;
+			const ViscosityKernel &viscosity_kernel = get_kernels(global_id).viscosity;
+			const float32x8_t h2_8 = float32x8_t(viscosity_kernel.h2);
+
+			// the unused part of the kick is taken back when a neighbor interrupts the level step
+			TimeLevel *level = (multirate) ? &time_levels[global_id] : nullptr;
+			if(level) {
+				if(substep && level->wake > substep) velocity -= level->kick * ((float32_t)(level->wake - substep) / (float32_t)(1u << level->level));
+				wake_flags[substep & 1][global_id] = 0;
+			}
+
+			Vector3f impulse = plane_collision(Vector4f(0.0f, 0.0f, 1.0f, 0.0f), position, velocity, radius);
+			Vector3f attraction = Vector3f(0.0f);
+			Vector3f pressure_force = Vector3f(0.0f);
+			Vector3f viscosity_force = Vector3f(0.0f);
+
+			if(interaction.w == 1.0f) {
+				attraction = sphere_collision(position, velocity, Vector3f(interaction), Vector3f(0.0f), 0.6f);
+			}
+
+			// incompressible solvers apply their pressures after the non-pressure forces
+			float32_t mass = masses[global_id];
+			float32_t pressure = (pressure_solver == PressureEOS) ? pressures[global_id] : 0.0f;
+			float32_t density = densities[global_id];
+
+			float32x8_t x0 = float32x8_t(position.x);
+			float32x8_t y0 = float32x8_t(position.y);
+			float32x8_t z0 = float32x8_t(position.z);
+
+			NeighborForces forces(pressure_kernel, viscosity_kernel, (pressure_solver != PressureEOS), velocity, mass, density, pressure, radius);
+			float32x8_t min_level_8 = max_level_8;
+			float32x8_t max_levels_8 = zero;
+
+			if(lists_valid) {
+
+				// iterate the neighbor list, lanes past the neighbor count are masked
+				uint32_t offset = list_offsets[global_id];
+				uint32_t count = list_counts[global_id];
+				float32x8_t last = float32x8_t((float32_t)count - 0.5f);
+				stats.candidates += count;
+				for(uint32_t i = 0; i < count; i += ParticleStore::Width) {
+					const uint32_t *TS_RESTRICT index = list_indices.get() + offset + i;
+					float32x8_t mask = lanes + (float32_t)i - last;
+
+					float32x8_t dx, dy, dz, r2, r;
+					if(list_data) {
+						const float32_t *TS_RESTRICT data = list_data + (offset + i) * 4;
+						dx = float32x8_t(data + ParticleStore::Width * 0);
+						dy = float32x8_t(data + ParticleStore::Width * 1);
+						dz = float32x8_t(data + ParticleStore::Width * 2);
+						r = float32x8_t(data + ParticleStore::Width * 3);
+						r2 = r * r;
+					} else {
+						dx = x0 - gather(sx, index);
+						dy = y0 - gather(sy, index);
+						dz = z0 - gather(sz, index);
+						r2 = dx * dx + dy * dy + dz * dz;
+						r = sqrt(r2);
+					}
+
+					forces.add(mask, dx, dy, dz, r2, r, gather(svx, index), gather(svy, index), gather(svz, index), gather(smasses, index), gather(sdensities, index), gather(spressures, index));
+
+					if(multirate) {
+						float32x8_t neighbor_level = gather(level_data, index);
+						float32x8_t kernel_mask = max(mask, r2 - h2_8);
+						min_level_8 = min(min_level_8, select(max_level_8, neighbor_level, kernel_mask));
+						max_levels_8 = max(max_levels_8, select(zero, neighbor_level, kernel_mask));
+					}
+				}
+
+			} else {
+
+				float32x8_t self = float32x8_t((float32_t)slots[global_id]);
+
+				uint32_t num_ranges = get_ranges(global_id, position, range_begin, range_end);
+				for(uint32_t r = 0; r < num_ranges; r++) {
+
+					// blocks start at the aligned index, lanes outside of the range and the particle itself are masked
+					float32x8_t first = float32x8_t((float32_t)range_begin[r] - 0.5f);
+					float32x8_t last = float32x8_t((float32_t)range_end[r] - 0.5f);
+					stats.candidates += range_end[r] - range_begin[r];
+					for(uint32_t i = range_begin[r] & ~(uint32_t)(ParticleStore::Width - 1); i < range_end[r]; i += ParticleStore::Width) {
+						float32x8_t lane = lanes + (float32_t)i;
+						float32x8_t mask = max(max(first - lane, lane - last), half - abs(lane - self));
+
+						float32x8_t dx = x0 - float32x8_t(sx + i);
+						float32x8_t dy = y0 - float32x8_t(sy + i);
+						float32x8_t dz = z0 - float32x8_t(sz + i);
+						float32x8_t r2 = dx * dx + dy * dy + dz * dz;
+
+						forces.add(mask, dx, dy, dz, r2, sqrt(r2), float32x8_t(svx + i), float32x8_t(svy + i), float32x8_t(svz + i), float32x8_t(smasses + i), float32x8_t(sdensities + i), float32x8_t(spressures + i));
+
+						if(multirate) {
+							float32x8_t neighbor_level = float32x8_t(level_data + i);
+							float32x8_t kernel_mask = max(mask, r2 - h2_8);
+							min_level_8 = min(min_level_8, select(max_level_8, neighbor_level, kernel_mask));
+							max_levels_8 = max(max_levels_8, select(zero, neighbor_level, kernel_mask));
+						}
+					}
+				}
+			}
+
+			Vector3f contact = Vector3f(forces.impulse_x.sum(), forces.impulse_y.sum(), forces.impulse_z.sum());
+			pressure_force = Vector3f(forces.pressure_x.sum(), forces.pressure_y.sum(), forces.pressure_z.sum());
+			viscosity_force = Vector3f(forces.viscosity_x.sum(), forces.viscosity_y.sum(), forces.viscosity_z.sum());
+			stats.neighbors += (uint64_t)forces.neighbors.sum();
+
+			viscosity_force *= physics.viscosity;
+
+			Vector3f force = -pressure_force + viscosity_force + Vector3f(0.0f, 0.0f, physics.gravity);
+
+			// step of the particle level
+			float32_t dt = ifps;
+			uint32_t coarse_level = 0;
+			if(level) {
+				float32_t neighbor_level = (float32_t)MaxTimeLevels;
+				for(uint32_t i = 0; i < ParticleStore::Width; i++) {
+					neighbor_level = min(neighbor_level, min_level_8.v[i]);
+					coarse_level = max(coarse_level, (uint32_t)max_levels_8.v[i]);
+				}
+				level->level = get_level(velocity + impulse + contact, force * mass + attraction * 20.0f, (uint32_t)neighbor_level);
+				level->wake = substep + (1u << level->level);
+				dt = ifps * (float32_t)(1u << level->level);
+			}
+
+			if(interaction.w == 1.0f) impulse += attraction * (dt * 20.0f);
+			impulse += contact;
+			impulse += force * (dt * mass);
+
+			// velocities of the non-pressure forces are corrected by the pressure solve
+			if(pressure_solver != PressureEOS) {
+				dest.setVelocity(global_id, velocity + impulse);
+				continue;
+			}
+
+			float32_t len = length(impulse);
+			if(len > 32.0f) impulse *= 32.0f / len;
+
+			// integrate
+			velocity += impulse;
+			position += velocity * ifps;
+
+			// neighbors more than one level coarser are woken by the next substep
+			if(level) {
+				level->kick = impulse;
+				if(coarse_level > level->level + 1) {
+					NeighborStats wake_stats;
+					float32x8_t finest_level = float32x8_t((float32_t)level->level + 1.5f);
+					Atomici32 *TS_RESTRICT flags = wake_flags[(substep + 1) & 1].get();
+					for_neighbors(global_id, src.getPosition(global_id), wake_stats, [&](const float32x8_t &mask, const float32x8_t&, const float32x8_t&, const float32x8_t&, const float32x8_t &r2, const NeighborLanes &neighbor) {
+						float32x8_t wake_mask = max(max(mask, r2 - h2_8), finest_level - neighbor.get(level_data));
+						for(uint32_t i = 0; i < ParticleStore::Width; i++) {
+							if(wake_mask.v[i] < 0.0f) flags[indices[(neighbor.index) ? neighbor.index[i] : neighbor.offset + i]] |= 1;
+						}
+					});
+				}
+			}
+
+			store_particle(global_id, position, velocity, motion);
+		}
+	}
+
+	uint32_t CPUSolver::get_level(const Vector3f &velocity, const Vector3f &acceleration, uint32_t neighbor_level) const {
+
+		// CFL condition of the particle diameter and the acceleration criterion
+		float32_t diameter = parameters.radius * 2.0f;
+		float32_t speed = length(velocity);
+		float32_t force = length(acceleration);
+		float32_t dt = Maxf32;
+		if(speed > 0.0f) dt = level_cfl * diameter / speed;
+		if(force > 0.0f) dt = min(dt, level_cfl * Tellusim::sqrt(diameter / force));
+
+		// levels differ by at most one from their neighbors and end at a substep aligned to their step
+		uint32_t max_level = min(num_levels - 1, neighbor_level + 1);
+		for(uint32_t i = 0; i < max_level; i++) {
+			if(substep & (1u << i)) max_level = i;
+		}
+
+		uint32_t level = 0;
+		while(level < max_level && parameters.ifps * (float32_t)(2u << level) <= dt) level++;
+		return level;
+	}
+
+	void CPUSolver::store_particle(uint32_t global_id, Vector3f position, Vector3f velocity, TaskMotion &motion) {
+
+		const ParticleStore &src = particles[0];
+		ParticleStore &dest = particles[1];
+
+		// time step limits of the integrated velocity
+		motion.speed = max(motion.speed, length2(velocity));
+		motion.acceleration = max(motion.acceleration, length2(velocity - src.getVelocity(global_id)));
+
+		// limit position/velocity to a cube
+		const float32_t box_size = get_physics(global_id).box_size;
+		if(position.x > box_size) {
+			position.x = box_size;
+			velocity.x = min(velocity.x * -0.3f, -0.2f);
+		}
+		if(position.x < -box_size) {
+			position.x = -box_size;
+			velocity.x = max(velocity.x * -0.3f, 0.2f);
+		}
+		if(position.y > box_size) {
+			position.y = box_size;
+			velocity.y = min(velocity.y * -0.3f, -0.2f);
+		}
+		if(position.y < -box_size) {
+			position.y = -box_size;
+			velocity.y = max(velocity.y * -0.3f, 0.2f);
+		}
+
+		dest.setPosition(global_id, position);
+		dest.setVelocity(global_id, velocity);
+
+		// carry the scalar channels over to the swapped state
+		dest.get(ParticleStore::ChannelDensity)[global_id] = src.get(ParticleStore::ChannelDensity)[global_id];
+		dest.get(ParticleStore::ChannelPressure)[global_id] = src.get(ParticleStore::ChannelPressure)[global_id];
+		dest.get(ParticleStore::ChannelMass)[global_id] = src.get(ParticleStore::ChannelMass)[global_id];
+
+		hashes[global_id] = get_hash(get_index(position, parameters, parameters.hash_offset), grid_size) + get_scene_cells(global_id);
+
+		// squared displacement since the last grid build
+		if(skin > 0.0f) motion.displacement = max(motion.displacement, length2(position - references[global_id]));
+	}
+
+	/*
+	 */
+	void CPUSolver::dispatch_pressure() {
+
+		// coefficients are read in aligned blocks of the cell ranges, the padding lanes are zero
+		if(factors.size() != size) {
+			factors.resize(size);
+			kappas.resize(size + ParticleStore::Width * 2, 0.0f);
+			size_t address = (size_t)kappas.get();
+			kappa_data = (float32_t*)((address + ParticleStore::Alignment - 1) & ~(size_t)(ParticleStore::Alignment - 1));
+		}
+
+		// rest density of the particles packed at the contact distance
+		if(rest_density == 0.0f) {
+			rest_density = pressure_parameters.rest_density;
+			if(rest_density <= 0.0f) {
+				const float32_t *masses = particles[0].get(ParticleStore::ChannelMass);
+				float64_t mass = 0.0;
+				for(uint32_t i = 0; i < size; i++) mass += masses[i];
+				float32_t spacing = parameters.radius * 2.0f;
+				if(support_kernel == KernelWendland) rest_density = get_lattice_density(wendland_kernel, (float32_t)(mass / size), spacing, pressure_parameters.support);
+				else rest_density = get_lattice_density(cubic_kernel, (float32_t)(mass / size), spacing, pressure_parameters.support);
+			}
+		}
+
+		// densities and factors of the current positions
+		dispatch_pass(factors_pass, &density_stats);
+
+		// divergence-free velocities of the current state
+		pressure_stats = PressureStats();
+		pressure_divergence = true;
+		dispatch_pass(&CPUSolver::load_velocities);
+		if(pressure_solver == PressureDFSPH && pressure_parameters.max_divergence_iterations) {
+			pressure_stats.divergence_iterations = dispatch_solve(pressure_parameters.divergence_tolerance, pressure_parameters.max_divergence_iterations, pressure_stats.divergence_error);
+			dispatch_pass(&CPUSolver::store_velocities);
+		}
+
+		// velocities of the non-pressure forces
+		dispatch_pass(&CPUSolver::update_simulation, &force_stats);
+
+		// constant density velocities and the new positions
+		// IISPH starts from the pressure accelerations of the halved previous pressures
+		pressure_divergence = false;
+		dispatch_pass(&CPUSolver::load_velocities);
+		if(pressure_solver == PressureIISPH) dispatch_pass(pressures_pass);
+		pressure_stats.density_iterations = dispatch_solve(pressure_parameters.density_tolerance, pressure_parameters.max_density_iterations, pressure_stats.density_error);
+		dispatch_pass(&CPUSolver::update_integration);
+
+		pressure_totals.density_iterations += pressure_stats.density_iterations;
+		pressure_totals.divergence_iterations += pressure_stats.divergence_iterations;
+		pressure_totals.density_error += pressure_stats.density_error;
+		pressure_totals.divergence_error += pressure_stats.divergence_error;
+		num_pressure_steps++;
+	}
+
+	uint32_t CPUSolver::dispatch_solve(float32_t tolerance, uint32_t max_iterations, float32_t &error) {
+
+		// Jacobi iterations until the average error is below the tolerance
+		uint32_t iterations = 0;
+		while(true) {
+			dispatch_pass(errors_pass);
+			float64_t sum = 0.0;
+			for(float32_t task : task_errors) sum += task;
+			error = (float32_t)(sum / size) / rest_density;
+			if(iterations >= max_iterations) break;
+			if(iterations >= pressure_parameters.min_iterations && error <= tolerance) break;
+			dispatch_pass(pressures_pass);
+			iterations++;
+		}
+
+		return iterations;
+	}
+
+	/*
+	 */
+	template <class Kernel> void CPUSolver::update_factors(uint32_t begin, uint32_t end) {
+
+		const float32_t dt = parameters.ifps;
+		const Kernel &kernel = get_kernel<Kernel>();
+		const float32x8_t zero = float32x8_t(0.0f);
+		const float32x8_t one = float32x8_t(1.0f);
+		const float32x8_t h2_8 = float32x8_t(pressure_parameters.support * pressure_parameters.support);
+
+		ParticleStore &src = particles[0];
+		const float32_t *TS_RESTRICT masses = src.get(ParticleStore::ChannelMass);
+		float32_t *TS_RESTRICT densities = src.get(ParticleStore::ChannelDensity);
+		float32_t *TS_RESTRICT pressures = src.get(ParticleStore::ChannelPressure);
+
+		const float32_t *TS_RESTRICT smasses = sorted.get(ParticleStore::ChannelMass);
+		float32_t *TS_RESTRICT sdensities = sorted.get(ParticleStore::ChannelDensity);
+		float32_t *TS_RESTRICT spressures = sorted.get(ParticleStore::ChannelPressure);
+
+		NeighborStats &stats = task_stats[begin / task_step];
+
+		for(uint32_t global_id = begin; global_id < end; global_id++) {
+
+			float32x8_t density_8 = zero;
+			float32x8_t gradient_x = zero, gradient_y = zero, gradient_z = zero;
+			float32x8_t gradient2_8 = zero;
+			float32x8_t mass_gradient2_8 = zero;
+			float32x8_t neighbors_8 = zero;
+
+			for_neighbors(global_id, src.getPosition(global_id), stats, [&](const float32x8_t &mask, const float32x8_t &dx, const float32x8_t &dy, const float32x8_t &dz, const float32x8_t &r2, const NeighborLanes &neighbor) {
+				float32x8_t r = sqrt(r2);
+				float32x8_t kernel_mask = max(mask, r2 - h2_8);
+				float32x8_t mass_1 = select(zero, neighbor.get(smasses), kernel_mask);
+				float32x8_t kernel_gradient = kernel.getGradient(r);
+				float32x8_t gradient = mass_1 * kernel_gradient;
+				density_8 += mass_1 * kernel.get(r);
+				gradient_x += dx * gradient;
+				gradient_y += dy * gradient;
+				gradient_z += dz * gradient;
+				gradient2_8 += gradient * gradient * r2;
+				mass_gradient2_8 += gradient * kernel_gradient * r2;
+				neighbors_8 += select(zero, one, kernel_mask);
+			});
+			stats.neighbors += (uint64_t)neighbors_8.sum();
+
+			// the factor scales the density error to the pressure increment
+			float32_t density = density_8.sum() + masses[global_id] * kernel.get(0.0f);
+			Vector3f gradient = Vector3f(gradient_x.sum(), gradient_y.sum(), gradient_z.sum());
+			uint32_t slot = slots[global_id];
+			if(pressure_solver == PressureIISPH) {
+				float32_t diagonal = (dot(gradient, gradient) + masses[global_id] * mass_gradient2_8.sum()) * (dt * dt);
+				factors[slot] = (diagonal > 1e-12f) ? pressure_parameters.relaxation * density * density / diagonal : 0.0f;
+				pressures[global_id] *= 0.5f;
+				kappa_data[slot] = pressures[global_id] / (density * density);
+			} else {
+				float32_t denominator = dot(gradient, gradient) + gradient2_8.sum();
+				factors[slot] = (denominator > 1e-6f) ? density / denominator : 0.0f;
+				pressures[global_id] = 0.0f;
+			}
+
+			// pressure forces are replaced by the solves
+			densities[global_id] = density;
+			sdensities[slot] = density;
+			spressures[slot] = 0.0f;
+		}
+	}
+
+	template <class Kernel> void CPUSolver::update_errors(uint32_t begin, uint32_t end) {
+
+		const float32_t dt = parameters.ifps;
+		const Kernel &kernel = get_kernel<Kernel>();
+		const float32x8_t zero = float32x8_t(0.0f);
+		const float32x8_t h2_8 = float32x8_t(pressure_parameters.support * pressure_parameters.support);
+
+		const float32_t *TS_RESTRICT svx = sorted.get(ParticleStore::ChannelVX);
+		const float32_t *TS_RESTRICT svy = sorted.get(ParticleStore::ChannelVY);
+		const float32_t *TS_RESTRICT svz = sorted.get(ParticleStore::ChannelVZ);
+		const float32_t *TS_RESTRICT smasses = sorted.get(ParticleStore::ChannelMass);
+		const float32_t *TS_RESTRICT sdensities = sorted.get(ParticleStore::ChannelDensity);
+		float32_t *TS_RESTRICT pressures = particles[0].get(ParticleStore::ChannelPressure);
+
+		NeighborStats &stats = task_stats[begin / task_step];
+		float32_t &task_error = task_errors[begin / task_step];
+
+		for(uint32_t global_id = begin; global_id < end; global_id++) {
+
+			uint32_t slot = slots[global_id];
+			float32x8_t vx0 = float32x8_t(svx[slot]);
+			float32x8_t vy0 = float32x8_t(svy[slot]);
+			float32x8_t vz0 = float32x8_t(svz[slot]);
+
+			// density change from the relative velocities
+			float32x8_t divergence_8 = zero;
+			for_neighbors(global_id, particles[0].getPosition(global_id), stats, [&](const float32x8_t &mask, const float32x8_t &dx, const float32x8_t &dy, const float32x8_t &dz, const float32x8_t &r2, const NeighborLanes &neighbor) {
+				float32x8_t gradient = select(zero, neighbor.get(smasses) * kernel.getGradient(sqrt(r2)), max(mask, r2 - h2_8));
+				divergence_8 += ((vx0 - neighbor.get(svx)) * dx + (vy0 - neighbor.get(svy)) * dy + (vz0 - neighbor.get(svz)) * dz) * gradient;
+			});
+			float32_t divergence = divergence_8.sum();
+
+			// only compression is corrected
+			float32_t density = sdensities[slot];
+			float32_t error = 0.0f;
+			if(pressure_divergence) {
+				error = max(divergence, 0.0f);
+				kappa_data[slot] = error * factors[slot] / (dt * density);
+			} else if(pressure_solver == PressureIISPH) {
+				float32_t residual = density + divergence * dt - rest_density;
+				float32_t pressure = max(pressures[global_id] + residual * factors[slot], 0.0f);
+				kappa_data[slot] = (pressure - pressures[global_id]) / (density * density);
+				pressures[global_id] = pressure;
+				error = max(residual, 0.0f);
+			} else {
+				error = max(density + divergence * dt - rest_density, 0.0f);
+				kappa_data[slot] = error * factors[slot] / (dt * dt * density);
+			}
+			task_error += error;
+		}
+	}
+
+	template <class Kernel> void CPUSolver::update_pressures(uint32_t begin, uint32_t end) {
+
+		const float32_t dt = parameters.ifps;
+		const Kernel &kernel = get_kernel<Kernel>();
+		const float32x8_t zero = float32x8_t(0.0f);
+		const float32x8_t h2_8 = float32x8_t(pressure_parameters.support * pressure_parameters.support);
+
+		const float32_t *TS_RESTRICT smasses = sorted.get(ParticleStore::ChannelMass);
+		const float32_t *TS_RESTRICT skappas = kappa_data;
+
+		NeighborStats &stats = task_stats[begin / task_step];
+
+		for(uint32_t global_id = begin; global_id < end; global_id++) {
+
+			// the particle writes only its own velocity, the pass reads the coefficients
+			uint32_t slot = slots[global_id];
+			float32x8_t kappa_0 = float32x8_t(skappas[slot]);
+
+			float32x8_t acceleration_x = zero, acceleration_y = zero, acceleration_z = zero;
+			for_neighbors(global_id, particles[0].getPosition(global_id), stats, [&](const float32x8_t &mask, const float32x8_t &dx, const float32x8_t &dy, const float32x8_t &dz, const float32x8_t &r2, const NeighborLanes &neighbor) {
+				float32x8_t gradient = select(zero, neighbor.get(smasses) * kernel.getGradient(sqrt(r2)), max(mask, r2 - h2_8));
+				float32x8_t scale = (kappa_0 + neighbor.get(skappas)) * gradient;
+				acceleration_x += dx * scale;
+				acceleration_y += dy * scale;
+				acceleration_z += dz * scale;
+			});
+
+			Vector3f acceleration = Vector3f(acceleration_x.sum(), acceleration_y.sum(), acceleration_z.sum());
+			sorted.setVelocity(slot, sorted.getVelocity(slot) - acceleration * dt);
+		}
+	}
+
+	void CPUSolver::update_integration(uint32_t begin, uint32_t end) {
+
+		const float32_t dt = parameters.ifps;
+
+		ParticleStore &src = particles[0];
+		const float32_t *TS_RESTRICT densities = src.get(ParticleStore::ChannelDensity);
+		float32_t *TS_RESTRICT pressures = src.get(ParticleStore::ChannelPressure);
+
+		TaskMotion &motion = task_motions[begin / task_step];
+
+		for(uint32_t global_id = begin; global_id < end; global_id++) {
+			uint32_t slot = slots[global_id];
+			Vector3f velocity = sorted.getVelocity(slot);
+
+			// DFSPH pressure of the last density error
+			if(pressure_solver == PressureDFSPH) pressures[global_id] = kappa_data[slot] * densities[global_id];
+
+			store_particle(global_id, src.getPosition(global_id) + velocity * dt, velocity, motion);
+		}
+	}
+
+	/*
+	 */
+	void CPUSolver::load_velocities(uint32_t begin, uint32_t end) {
+
+		// current velocities for the divergence solve, predicted velocities for the density solve
+		const ParticleStore &src = particles[(pressure_divergence) ? 0 : 1];
+		for(uint32_t i = begin; i < end; i++) {
+			sorted.setVelocity(slots[i], src.getVelocity(i));
+		}
+	}
+
+	void CPUSolver::store_velocities(uint32_t begin, uint32_t end) {
+		ParticleStore &dest = particles[0];
+		for(uint32_t i = begin; i < end; i++) {
+			dest.setVelocity(i, sorted.getVelocity(slots[i]));
+		}
+	}
+
+	/*
+	 */
+	void CPUSolver::update_grid() {
+
+		// stable counting sort of the particle hashes
+		// matches the SpatialGrid ranges layout: begin and end index per cell
+		for(uint32_t &range : ranges) range = 0;
+		for(uint32_t i = 0; i < size; i++) {
+			ranges[hashes[i] * 2 + 1]++;
+		}
+
+		uint32_t offset = 0;
+		for(uint32_t i = 0; i < ranges.size(); i += 2) {
+			uint32_t count = ranges[i + 1];
+			ranges[i + 0] = offset;
+			ranges[i + 1] = offset;
+			offset += count;
+		}
+
+		for(uint32_t i = 0; i < size; i++) {
+			indices[ranges[hashes[i] * 2 + 1]++] = i;
+		}
+	}
+
+	void CPUSolver::update_sorted(uint32_t begin, uint32_t end) {
+
+		// gather the destination state in the cell order for the next step
+		const ParticleStore &src = particles[1];
+		for(uint32_t i = begin; i < end; i++) {
+			uint32_t j = indices[i];
+			sorted.setPosition(i, src.getPosition(j));
+			sorted.setVelocity(i, src.getVelocity(j));
+			sorted.get(ParticleStore::ChannelMass)[i] = src.get(ParticleStore::ChannelMass)[j];
+			slots[j] = i;
+		}
+
+		// densities and pressures of the particles between their level updates
+		if(has_time_levels()) {
+			for(uint32_t i = begin; i < end; i++) {
+				uint32_t j = indices[i];
+				sorted.get(ParticleStore::ChannelDensity)[i] = src.get(ParticleStore::ChannelDensity)[j];
+				sorted.get(ParticleStore::ChannelPressure)[i] = src.get(ParticleStore::ChannelPressure)[j];
+				level_data[i] = (float32_t)time_levels[j].level;
+			}
+		}
+
+		// reference positions of the skin
+		if(skin > 0.0f && grid_rebuilt) {
+			for(uint32_t i = begin; i < end; i++) {
+				references[i] = src.getPosition(i);
+			}
+		}
+	}
+
+	/*
+	 */
+	void CPUSolver::update_order() {
+
+		// Morton keys of the current particle cells
+		reorder_keys.resize(size);
+		reorder_values.resize(size);
+		reorder_scratch.resize(size * 3);
+		reorder_references.resize(references.size());
+		reorder_levels.resize(time_levels.size());
+		reorder_scenes.resize(scenes.size());
+		dispatch_pass(&CPUSolver::update_keys);
+
+		// stable LSD radix sort of the keys and values
+		uint32_t *TS_RESTRICT src_keys = reorder_keys.get();
+		uint32_t *TS_RESTRICT src_values = reorder_values.get();
+		uint32_t *TS_RESTRICT dest_keys = reorder_scratch.get();
+		uint32_t *TS_RESTRICT dest_values = reorder_scratch.get() + size;
+		for(uint32_t shift = 0; shift < 30; shift += 10) {
+			uint32_t counts[1024] = {};
+			for(uint32_t i = 0; i < size; i++) {
+				counts[(src_keys[i] >> shift) & 1023u]++;
+			}
+			uint32_t offset = 0;
+			for(uint32_t &count : counts) {
+				uint32_t num = count;
+				count = offset;
+				offset += num;
+			}
+			for(uint32_t i = 0; i < size; i++) {
+				uint32_t j = counts[(src_keys[i] >> shift) & 1023u]++;
+				dest_keys[j] = src_keys[i];
+				dest_values[j] = src_values[i];
+			}
+			swap(src_keys, dest_keys);
+			swap(src_values, dest_values);
+		}
+		if(src_values != reorder_values.get()) memcpy(reorder_values.get(), src_values, sizeof(uint32_t) * size);
+
+		// permute all channels and the per particle state
+		dispatch_pass(&CPUSolver::update_reordered);
+		particles[0].swap(particles[1]);
+		memcpy(order.get(), reorder_scratch.get(), sizeof(uint32_t) * size);
+		memcpy(slots.get(), reorder_scratch.get() + size, sizeof(uint32_t) * size);
+		memcpy(hashes.get(), reorder_scratch.get() + size * 2, sizeof(uint32_t) * size);
+		references.swap(reorder_references);
+		time_levels.swap(reorder_levels);
+		scenes.swap(reorder_scenes);
+
+		// the grid keeps its cells, the particles of the sorted slots are renamed
+		// wake flags of the first substep are never read and are cleared by it
+		dispatch_pass(&CPUSolver::update_indices);
+
+		// lists refer to the previous order
+		lists_valid = false;
+		num_reorders++;
+	}
+
+	void CPUSolver::update_keys(uint32_t begin, uint32_t end) {
+		const ParticleStore &src = particles[0];
+		for(uint32_t i = begin; i < end; i++) {
+			reorder_keys[i] = get_morton(get_index(src.getPosition(i), parameters, parameters.hash_offset));
+			reorder_values[i] = i;
+		}
+	}
+
+	void CPUSolver::update_reordered(uint32_t begin, uint32_t end) {
+		const ParticleStore &src = particles[0];
+		ParticleStore &dest = particles[1];
+		for(uint32_t c = 0; c < ParticleStore::NumChannels; c++) {
+			const float32_t *TS_RESTRICT src_channel = src.get((ParticleStore::Channel)c);
+			float32_t *TS_RESTRICT dest_channel = dest.get((ParticleStore::Channel)c);
+			for(uint32_t i = begin; i < end; i++) {
+				dest_channel[i] = src_channel[reorder_values[i]];
+			}
+		}
+		uint32_t *TS_RESTRICT dest_order = reorder_scratch.get();
+		uint32_t *TS_RESTRICT dest_slots = reorder_scratch.get() + size;
+		uint32_t *TS_RESTRICT dest_hashes = reorder_scratch.get() + size * 2;
+		for(uint32_t i = begin; i < end; i++) {
+			uint32_t j = reorder_values[i];
+			dest_order[i] = order[j];
+			dest_slots[i] = slots[j];
+			dest_hashes[i] = hashes[j];
+			reorder_keys[j] = i;
+		}
+		if(reorder_references.size()) {
+			for(uint32_t i = begin; i < end; i++) {
+				reorder_references[i] = references[reorder_values[i]];
+			}
+		}
+		if(reorder_levels.size()) {
+			for(uint32_t i = begin; i < end; i++) {
+				reorder_levels[i] = time_levels[reorder_values[i]];
+			}
+		}
+		if(reorder_scenes.size()) {
+			for(uint32_t i = begin; i < end; i++) {
+				reorder_scenes[i] = scenes[reorder_values[i]];
+			}
+		}
+	}
+
+	void CPUSolver::update_indices(uint32_t begin, uint32_t end) {
+		for(uint32_t i = begin; i < end; i++) {
+			indices[i] = reorder_keys[indices[i]];
+		}
+	}
+}
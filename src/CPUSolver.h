@@ -0,0 +1,353 @@
+#ifndef __MPM_CPU_SOLVER_H__
+#define __MPM_CPU_SOLVER_H__
+
+#include <core/TellusimArray.h>
+#include <core/TellusimAsync.h>
+#include <core/TellusimAtomic.h>
+#include <math/TellusimMath.h>
+
+#include "Kernels.h"
+#include "Parameters.h"
+#include "ParticleStore.h"
+
+/*
+ */
+namespace Mpm {
+
+	/**
+	 * CPUSolver class
+	 * Multithreaded reference implementation of pressureDensity.comp and main.comp
+	 */
+	class CPUSolver {
+
+		public:
+
+			/// Neighbor search statistics
+			struct NeighborStats {
+				uint64_t candidates = 0;		// particles visited in the stencil cells
+				uint64_t neighbors = 0;			// candidates inside the kernel radius
+			};
+
+			/// Pressure solvers
+			enum PressureSolver {
+				PressureEOS = 0,				// weakly compressible equation of state of pressureDensity.comp
+				PressureDFSPH,					// divergence-free and constant density solves
+				PressureIISPH,					// implicit pressure Poisson equation with relaxed Jacobi
+				NumPressureSolvers,
+			};
+
+			/// Pressure solver parameters
+			struct PressureParameters {
+				float32_t support = 0.12f;				// kernel support radius, must be covered by the grid search radius
+				float32_t rest_density = 0.0f;			// zero derives it from particles packed at the contact distance
+				float32_t density_tolerance = 0.01f;	// average density error relative to the rest density
+				float32_t divergence_tolerance = 0.1f;	// average density change per second relative to the rest density
+				uint32_t min_iterations = 2;
+				uint32_t max_density_iterations = 100;
+				uint32_t max_divergence_iterations = 100;	// zero disables the divergence-free solve
+				float32_t relaxation = 0.5f;			// IISPH Jacobi relaxation
+				bool tabulated = false;					// interpolate the kernel from a table instead of evaluating it
+			};
+
+			/// Pressure solver statistics of the last step or summed over the steps
+			struct PressureStats {
+				uint32_t density_iterations = 0;
+				uint32_t divergence_iterations = 0;
+				float32_t density_error = 0.0f;			// relative average density error
+				float32_t divergence_error = 0.0f;		// relative average density change per second
+			};
+
+			CPUSolver();
+			~CPUSolver();
+
+			/// clear solver
+			void clear();
+
+			/// create solver
+			/// \param async Async task scheduler used for the particle passes.
+			/// \param size Number of particles.
+			/// \param grid_size Number of spatial grid cells along each axis.
+			/// \param num_scenes Number of ensemble scenes, every scene has its own block of grid cells.
+			bool create(Async &async, uint32_t size, const Vector3u &grid_size, uint32_t num_scenes = 1);
+
+			/// set particle state and clear the spatial grid
+			/// \param scenes Scene of every particle, required with several scenes.
+			void setParticles(const ParticleStore &particles, const uint32_t *scenes = nullptr);
+
+			/// physical parameters of every ensemble scene
+			/// the parameters of the compute parameters are used by a single scene.
+			void setSceneParameters(const PhysicsParameters *parameters);
+			TS_INLINE uint32_t getNumScenes() const { return num_scenes; }
+
+			/// interaction sphere (w is 1 when active)
+			void setInteraction(const Vector4f &interaction);
+
+			/// neighbor lists built once per step and shared by the density and force passes
+			/// \param distances Cache neighbor deltas and distances in the lists.
+			/// \param max_bytes Memory budget, the passes search the grid when the lists exceed it.
+			void setNeighborLists(bool enabled, bool distances = false, size_t max_bytes = (size_t)512 << 20);
+			TS_INLINE bool hasNeighborLists() const { return lists_valid; }
+			size_t getNeighborListBytes() const;
+
+			/// Verlet skin, the grid and the lists are rebuilt when a particle moves further than half of the skin
+			/// the grid cells must cover the search radius extended by the skin, cached list distances are not used.
+			void setSkin(float32_t skin);
+			TS_INLINE float32_t getSkin() const { return skin; }
+
+			/// Morton order of the particle cells, all channels are permuted every interval steps
+			/// \param interval Number of steps between the reorderings, zero disables them.
+			TS_INLINE void setReorderInterval(uint32_t interval) { reorder_interval = interval; }
+			TS_INLINE uint32_t getReorderInterval() const { return reorder_interval; }
+
+			/// multi-rate integration of the equation of state pressure
+			/// particles are binned into power-of-two time step levels by their CFL limit and only updated at their own rate,
+			/// the finest level steps the time step over 2^(num_levels - 1) substeps, all levels end at the step.
+			/// \param num_levels Number of levels, one disables the multi-rate integration.
+			/// \param cfl Fraction of the particle diameter traveled by the particle in one level step.
+			void setTimeLevels(uint32_t num_levels, float32_t cfl = 0.4f);
+			TS_INLINE uint32_t getNumTimeLevels() const { return num_levels; }
+			void getTimeLevels(uint32_t *counts) const;
+
+			/// maximum particle speed and acceleration of the last step
+			/// reduced by the integration pass for the adaptive time step.
+			TS_INLINE float32_t getMaxSpeed() const { return max_speed; }
+			TS_INLINE float32_t getMaxAcceleration() const { return max_acceleration; }
+
+			/// deterministic mode, the passes are split into fixed tasks independent of the number of threads
+			/// results are bitwise reproducible for the same build, parameters and particle state.
+			TS_INLINE void setDeterministic(bool enabled) { deterministic = enabled; }
+			TS_INLINE bool isDeterministic() const { return deterministic; }
+
+			/// pressure solver, the incompressible solvers use the neighbor grid and lists of the passes
+			void setPressureSolver(PressureSolver solver, const PressureParameters &parameters);
+			TS_INLINE PressureSolver getPressureSolver() const { return pressure_solver; }
+			TS_INLINE const PressureParameters &getPressureParameters() const { return pressure_parameters; }
+			TS_INLINE const PressureStats &getPressureStats() const { return pressure_stats; }
+			TS_INLINE const PressureStats &getPressureTotals() const { return pressure_totals; }
+			TS_INLINE uint32_t getNumPressureSteps() const { return num_pressure_steps; }
+			TS_INLINE float32_t getRestDensity() const { return rest_density; }
+
+			/// simulate one step
+			/// density/pressure pass, simulation pass and spatial grid build
+			void dispatch(const ComputeParameters &parameters);
+
+			/// particle state in the simulation order
+			TS_INLINE uint32_t getSize() const { return size; }
+			TS_INLINE const ParticleStore &getParticles() const { return particles[0]; }
+
+			/// source particle indices of the simulation order
+			TS_INLINE const Array<uint32_t> &getOrder() const { return order; }
+			TS_INLINE uint32_t getNumReorders() const { return num_reorders; }
+
+			/// hash of the particle state in the loaded order
+			uint64_t getStateHash() const;
+
+			/// neighbor statistics accumulated since the last reset
+			void resetStats();
+			TS_INLINE const NeighborStats &getDensityStats() const { return density_stats; }
+			TS_INLINE const NeighborStats &getForceStats() const { return force_stats; }
+			TS_INLINE uint32_t getNumRebuilds() const { return num_rebuilds; }
+			TS_INLINE uint64_t getNumUpdates() const { return num_updates; }
+
+		private:
+
+			/// run the particle pass over all threads
+			/// \param stats Neighbor statistics of the pass tasks are added to it.
+			void dispatch_pass(void (CPUSolver::*func)(uint32_t, uint32_t), NeighborStats *stats = nullptr);
+
+			/// spatial grid, particle passes and swap of one step or one substep of the time levels
+			void dispatch_step();
+
+			/// particle passes
+			void update_density(uint32_t begin, uint32_t end);
+			void update_simulation(uint32_t begin, uint32_t end);
+
+			/// per task maximums of the integration
+			struct TaskMotion {
+				float32_t displacement = 0.0f;	// squared displacement since the last grid build
+				float32_t speed = 0.0f;			// squared speed
+				float32_t acceleration = 0.0f;	// squared velocity change
+				uint32_t updates = 0;			// particles updated by the force pass
+			};
+
+			/// box limits and the destination state of the particle
+			TS_INLINE void store_particle(uint32_t global_id, Vector3f position, Vector3f velocity, TaskMotion &motion);
+
+			/// time level of the particle
+			struct TimeLevel {
+				Vector3f kick = Vector3f(0.0f);	// velocity change of the current level step
+				uint32_t level = 0;
+				uint32_t wake = 0;				// substep of the next update
+			};
+
+			/// particle is updated by the current substep
+			/// the level step ends or the particle is woken by a neighbor of a finer level.
+			TS_INLINE bool has_time_levels() const { return (num_levels > 1 && pressure_solver == PressureEOS); }
+			TS_INLINE bool is_active(uint32_t global_id) const {
+				return (!has_time_levels() || substep == 0 || time_levels[global_id].wake == substep || wake_flags[substep & 1][global_id].value);
+			}
+
+			/// level of the particle limited by its CFL condition, by the neighbor levels and by the current substep
+			TS_INLINE uint32_t get_level(const Vector3f &velocity, const Vector3f &acceleration, uint32_t neighbor_level) const;
+
+			/// DFSPH and IISPH passes
+			/// the solver state is stored in the cell order of the sorted store.
+			void dispatch_pressure();
+			uint32_t dispatch_solve(float32_t tolerance, uint32_t max_iterations, float32_t &error);
+			template <class Kernel> void update_factors(uint32_t begin, uint32_t end);
+			template <class Kernel> void update_errors(uint32_t begin, uint32_t end);
+			template <class Kernel> void update_pressures(uint32_t begin, uint32_t end);
+			void update_integration(uint32_t begin, uint32_t end);
+			void load_velocities(uint32_t begin, uint32_t end);
+			void store_velocities(uint32_t begin, uint32_t end);
+
+			/// support kernel of the scene physics
+			void update_support_kernel();
+
+			/// kernel passes of the selected support kernel
+			template <class Kernel> void set_kernel();
+			template <class Kernel> TS_INLINE const Kernel &get_kernel() const;
+
+			/// neighbor blocks of the particle from the lists or the grid, the particle itself is skipped
+			template <class Func> void for_neighbors(uint32_t global_id, const Vector3f &position, NeighborStats &stats, Func &&func) const;
+
+			/// spatial grid
+			void update_grid();
+			void update_sorted(uint32_t begin, uint32_t end);
+
+			/// Morton reordering
+			void update_order();
+			void update_keys(uint32_t begin, uint32_t end);
+			void update_reordered(uint32_t begin, uint32_t end);
+			void update_indices(uint32_t begin, uint32_t end);
+
+			/// per task neighbor lists
+			struct TaskList {
+				Array<uint32_t> indices;
+				Array<float32_t> distances;
+				uint32_t offset = 0;
+				bool overflow = false;
+			};
+
+			/// neighbor lists
+			void create_lists();
+			void update_lists(uint32_t begin, uint32_t end);
+			void update_offsets(uint32_t begin, uint32_t end);
+
+			/// neighbor cell ranges of the parameters stencil in the cells of the particle scene
+			/// cells along the x axis are contiguous and merged into one range.
+			uint32_t get_ranges(uint32_t global_id, const Vector3f &position, uint32_t *range_begin, uint32_t *range_end) const;
+
+			/// ensemble scene of the particle
+			TS_INLINE const PhysicsParameters &get_physics(uint32_t global_id) const { return (num_scenes > 1) ? scene_parameters[scenes[global_id]] : parameters.physics; }
+			TS_INLINE uint32_t get_scene_cells(uint32_t global_id) const { return (num_scenes > 1) ? scenes[global_id] * num_cells : 0; }
+
+			/// SPH kernels of the scene physics, built once per dispatch
+			struct SceneKernels {
+				SceneKernels() : SceneKernels(PhysicsParameters()) { }
+				explicit SceneKernels(const PhysicsParameters &physics) : density(physics.density_length), pressure(physics.smoothing_length), viscosity(physics.smoothing_length) { }
+				Poly6Kernel density;
+				SpikyKernel pressure;
+				ViscosityKernel viscosity;
+			};
+			TS_INLINE const SceneKernels &get_kernels(uint32_t global_id) const { return (num_scenes > 1) ? scene_kernels[scenes[global_id]] : kernels; }
+
+			Async *async = nullptr;
+
+			uint32_t size = 0;
+			Vector3u grid_size = Vector3u(0u);
+			uint32_t num_cells = 0;				// grid cells of one scene
+
+			// ensemble scenes
+			uint32_t num_scenes = 1;
+			Array<uint32_t> scenes;				// particle scenes, empty with a single scene
+			Array<uint32_t> reorder_scenes;
+			Array<PhysicsParameters> scene_parameters;
+			Array<SceneKernels> scene_kernels;
+			SceneKernels kernels;
+
+			ComputeParameters parameters = {};
+			Vector4f interaction = Vector4f(0.0f);
+
+			PressureSolver pressure_solver = PressureEOS;
+			PressureParameters pressure_parameters;
+			PressureStats pressure_stats;
+			PressureStats pressure_totals;
+			uint32_t num_pressure_steps = 0;
+			float32_t rest_density = 0.0f;
+			bool pressure_divergence = false;	// divergence or density errors of the current solve
+			Array<float32_t> factors;			// DFSPH factors or IISPH diagonal terms in the cell order
+			Array<float32_t> kappas;			// pressure increments over squared densities in the cell order
+			float32_t *kappa_data = nullptr;	// aligned coefficients
+			Array<float32_t> task_errors;		// per task error sum of the current pass
+
+			// support kernels of the incompressible solvers
+			uint32_t support_kernel = NumKernels;	// kernel of the current passes, NumKernels rebuilds them
+			CubicKernel cubic_kernel = CubicKernel(0.12f);
+			WendlandKernel wendland_kernel = WendlandKernel(0.12f);
+			KernelTable<CubicKernel> cubic_table;
+			KernelTable<WendlandKernel> wendland_table;
+			void (CPUSolver::*factors_pass)(uint32_t, uint32_t) = nullptr;
+			void (CPUSolver::*errors_pass)(uint32_t, uint32_t) = nullptr;
+			void (CPUSolver::*pressures_pass)(uint32_t, uint32_t) = nullptr;
+
+			bool deterministic = false;
+			uint32_t task_step = 0;
+			Array<NeighborStats> task_stats;	// per task statistics of the current pass
+			Array<TaskMotion> task_motions;		// per task maximums of the current pass
+			float32_t max_speed = 0.0f;
+			float32_t max_acceleration = 0.0f;
+			uint64_t num_updates = 0;			// particle force updates since the last reset
+			NeighborStats density_stats;
+			NeighborStats force_stats;
+
+			ParticleStore particles[2];			// 0 is the current state, 1 is the destination
+			ParticleStore sorted;				// particles in the cell order of the indices array
+
+			Array<uint32_t> hashes;				// particle cell hashes
+			Array<uint32_t> indices;			// particle indices sorted by hash
+			Array<uint32_t> ranges;				// cell ranges in the indices array
+			Array<uint32_t> slots;				// particle positions in the sorted store
+
+			float32_t skin = 0.0f;
+			bool grid_dirty = true;				// grid must be rebuilt at the end of the step
+			bool grid_rebuilt = false;			// grid was rebuilt by the last step
+			uint32_t num_rebuilds = 0;
+			Array<Vector3f> references;			// particle positions of the last grid build
+
+			enum {
+				MaxTimeLevels = 8,
+			};
+			uint32_t num_levels = 1;
+			float32_t level_cfl = 0.4f;
+			uint32_t substep = 0;				// substep of the finest level
+			Array<TimeLevel> time_levels;
+			Array<TimeLevel> reorder_levels;
+			Array<Atomici32> wake_flags[2];		// particles woken for the current and the next substep
+			Array<float32_t> levels;			// particle levels in the cell order
+			float32_t *level_data = nullptr;	// aligned levels
+
+			uint32_t reorder_interval = 0;
+			uint32_t reorder_step = 0;			// steps since the last reordering
+			uint32_t num_reorders = 0;
+			Array<uint32_t> order;				// source particle indices
+			Array<uint32_t> reorder_keys;		// Morton keys sorted with the reorder_values, then new particle indices of the previous order
+			Array<uint32_t> reorder_values;		// previous particle indices of the new order
+			Array<uint32_t> reorder_scratch;
+			Array<Vector3f> reorder_references;
+
+			bool use_lists = false;
+			bool cache_distances = false;
+			bool lists_valid = false;			// lists are used by the current step
+			bool list_overflow = false;			// lists exceeded the budget since the last reset
+			size_t list_budget = 0;
+			Array<uint32_t> list_offsets;		// particle list offsets aligned to the Width boundary
+			Array<uint32_t> list_counts;		// number of neighbors in the particle list
+			Array<uint32_t> list_indices;		// neighbor positions in the sorted store
+			Array<float32_t> list_distances;	// dx, dy, dz and distance blocks of Width neighbors
+			float32_t *list_data = nullptr;		// aligned list distances
+			Array<TaskList> task_lists;
+	};
+}
+
+#endif /* __MPM_CPU_SOLVER_H__ */
@@ -0,0 +1,227 @@
+#ifndef __MPM_KERNELS_H__
+#define __MPM_KERNELS_H__
+
+#include <core/TellusimArray.h>
+#include <math/TellusimMath.h>
+#include <math/TellusimSimd.h>
+
+/*
+ */
+namespace Mpm {
+
+	using namespace Tellusim;
+
+	/// Support kernels of the incompressible solvers
+	enum KernelType {
+		KernelCubic = 0,				// cubic spline
+		KernelWendland,					// Wendland C2
+		NumKernels,
+	};
+
+	/**
+	 * Smoothing kernels
+	 * Normalization constants are computed once per smoothing length by the constexpr constructors,
+	 * kernel functions take float32_t or float32x8_t arguments and leave the support masking to the caller
+	 */
+	namespace Kernels {
+
+		constexpr float32_t Pi = 3.1415927410125732421875f;
+
+		/// integer power
+		template <uint32_t N> constexpr float32_t pow(float32_t x) {
+			if constexpr(N == 0) return 1.0f;
+			else return pow<N - 1>(x) * x;
+		}
+
+		/// one minus the normalized distance clamped to the support
+		TS_INLINE float32_t clampSupport(float32_t q) { return (q < 1.0f) ? 1.0f - q : 0.0f; }
+		TS_INLINE float32x8_t clampSupport(const float32x8_t &q) { return max(float32x8_t(1.0f) - q, float32x8_t(0.0f)); }
+	}
+
+	/**
+	 * Poly6 density kernel of pressureDensity.comp
+	 */
+	struct Poly6Kernel {
+
+		constexpr explicit Poly6Kernel(float32_t h) : h2(h * h), scale(315.0f / (64.0f * Kernels::Pi * Kernels::pow<9>(h))) { }
+
+		/// kernel value without the normalization, sums are scaled once
+		template <class Type> TS_INLINE Type getShape(const Type &r2) const {
+			Type w = Type(h2) - r2;
+			return w * w * w;
+		}
+		template <class Type> TS_INLINE Type get(const Type &r2) const { return getShape(r2) * scale; }
+
+		float32_t h2;
+		float32_t scale;
+	};
+
+	/**
+	 * Spiky pressure gradient kernel of main.comp
+	 */
+	struct SpikyKernel {
+
+		constexpr explicit SpikyKernel(float32_t h) : h(h), scale(-45.0f / (Kernels::Pi * Kernels::pow<6>(h))) { }
+
+		/// gradient magnitude without the normalization, the pressure stiffness of main.comp absorbs it
+		template <class Type> TS_INLINE Type getGradientShape(const Type &r) const {
+			Type w = Type(h) - r;
+			return w * w;
+		}
+		template <class Type> TS_INLINE Type getGradient(const Type &r) const { return getGradientShape(r) * scale; }
+
+		float32_t h;
+		float32_t scale;
+	};
+
+	/**
+	 * Viscosity kernel of main.comp
+	 */
+	struct ViscosityKernel {
+
+		constexpr explicit ViscosityKernel(float32_t h) : h(h), h2(h * h), r3_scale(-1.0f / (2.0f * h * h * h)), r2_scale(1.0f / (h * h)), ir_scale(h * 0.5f),
+			laplacian_scale(45.0f / (Kernels::Pi * Kernels::pow<6>(h))) { }
+
+		/// kernel value without the normalization
+		/// \param ir Inverse distance shared with the other kernels of the neighbor.
+		template <class Type> TS_INLINE Type getShape(const Type &r2, const Type &r, const Type &ir) const {
+			return (r2 * r) * r3_scale + r2 * r2_scale + ir * ir_scale - 1.0f;
+		}
+
+		/// kernel Laplacian of the velocity diffusion
+		template <class Type> TS_INLINE Type getLaplacian(const Type &r) const { return (Type(h) - r) * laplacian_scale; }
+
+		float32_t h, h2;
+		float32_t r3_scale, r2_scale, ir_scale;
+		float32_t laplacian_scale;
+	};
+
+	/**
+	 * Cubic spline kernel with the support radius
+	 */
+	struct CubicKernel {
+
+		constexpr explicit CubicKernel(float32_t support) : ih(1.0f / support), sigma(8.0f / (Kernels::Pi * Kernels::pow<3>(support))) { }
+
+		/// kernel value
+		TS_INLINE float32_t get(float32_t r) const {
+			float32_t q = r * ih;
+			if(q >= 1.0f) return 0.0f;
+			if(q <= 0.5f) return (q * q * (q * 6.0f - 6.0f) + 1.0f) * sigma;
+			return (1.0f - q) * (1.0f - q) * (1.0f - q) * (sigma * 2.0f);
+		}
+		TS_INLINE float32x8_t get(const float32x8_t &r) const {
+			float32x8_t q = r * ih;
+			float32x8_t q1 = Kernels::clampSupport(q);
+			float32x8_t inner = (q * q) * (q * 6.0f - 6.0f) + 1.0f;
+			float32x8_t outer = q1 * q1 * q1 * 2.0f;
+			return select(outer, inner, q - 0.5f) * sigma;
+		}
+
+		/// kernel derivative over the distance, the gradient is the delta scaled by it
+		TS_INLINE float32_t getGradient(float32_t r) const {
+			float32_t q = r * ih;
+			if(q >= 1.0f) return 0.0f;
+			float32_t d = (q <= 0.5f) ? q * (q * 18.0f - 12.0f) : (1.0f - q) * (1.0f - q) * -6.0f;
+			return d * (sigma * ih) / max(r, 1e-6f);
+		}
+		TS_INLINE float32x8_t getGradient(const float32x8_t &r) const {
+			float32x8_t q = r * ih;
+			float32x8_t q1 = Kernels::clampSupport(q);
+			float32x8_t inner = q * (q * 18.0f - 12.0f);
+			float32x8_t outer = q1 * q1 * -6.0f;
+			return select(outer, inner, q - 0.5f) * (sigma * ih) / max(r, float32x8_t(1e-6f));
+		}
+
+		float32_t ih, sigma;
+	};
+
+	/**
+	 * Wendland C2 kernel with the support radius
+	 */
+	struct WendlandKernel {
+
+		constexpr explicit WendlandKernel(float32_t support) : ih(1.0f / support), sigma(21.0f / (2.0f * Kernels::Pi * Kernels::pow<3>(support))) { }
+
+		/// kernel value
+		template <class Type> TS_INLINE Type get(const Type &r) const {
+			Type q = r * ih;
+			Type q1 = Kernels::clampSupport(q);
+			Type q2 = q1 * q1;
+			return q2 * q2 * (q * 4.0f + 1.0f) * sigma;
+		}
+
+		/// kernel derivative over the distance, the gradient is the delta scaled by it
+		/// the derivative is -20 q (1 - q)^3, so the division by the distance is exact.
+		template <class Type> TS_INLINE Type getGradient(const Type &r) const {
+			Type q1 = Kernels::clampSupport(r * ih);
+			return q1 * q1 * q1 * (sigma * ih * ih * -20.0f);
+		}
+
+		float32_t ih, sigma;
+	};
+
+	/**
+	 * Tabulated support kernel
+	 * Values and gradients are sampled over the distance and linearly interpolated
+	 */
+	template <class Kernel> class KernelTable {
+
+			enum {
+				Size = 1024,
+			};
+
+		public:
+
+			/// sample the kernel of the support radius
+			void create(float32_t support) {
+				Kernel kernel(support);
+				scale = (float32_t)(Size - 1) / support;
+				values.resize(Size + 1);
+				gradients.resize(Size + 1);
+				for(uint32_t i = 0; i <= Size; i++) {
+					float32_t r = min((float32_t)i, (float32_t)(Size - 1)) / scale;
+					values[i] = kernel.get(r);
+					gradients[i] = (i) ? kernel.getGradient(r) : kernel.getGradient(0.5f / scale);
+				}
+			}
+			void clear() {
+				scale = 0.0f;
+				values.release();
+				gradients.release();
+			}
+
+			/// kernel value
+			TS_INLINE float32_t get(float32_t r) const { return interpolate(values.get(), r); }
+			TS_INLINE float32x8_t get(const float32x8_t &r) const { return interpolate(values.get(), r); }
+
+			/// kernel derivative over the distance
+			TS_INLINE float32_t getGradient(float32_t r) const { return interpolate(gradients.get(), r); }
+			TS_INLINE float32x8_t getGradient(const float32x8_t &r) const { return interpolate(gradients.get(), r); }
+
+		private:
+
+			TS_INLINE float32_t interpolate(const float32_t *TS_RESTRICT table, float32_t r) const {
+				float32_t x = min(r * scale, (float32_t)(Size - 1));
+				uint32_t i = (uint32_t)x;
+				return table[i] + (table[i + 1] - table[i]) * (x - (float32_t)i);
+			}
+			TS_INLINE float32x8_t interpolate(const float32_t *TS_RESTRICT table, const float32x8_t &r) const {
+				float32x8_t x = min(r * scale, float32x8_t((float32_t)(Size - 1)));
+				float32x8_t v0, v1, t;
+				for(uint32_t i = 0; i < 8; i++) {
+					uint32_t index = (uint32_t)x.v[i];
+					v0.v[i] = table[index];
+					v1.v[i] = table[index + 1];
+					t.v[i] = x.v[i] - (float32_t)index;
+				}
+				return v0 + (v1 - v0) * t;
+			}
+
+			float32_t scale = 0.0f;
+			Array<float32_t> values;
+			Array<float32_t> gradients;
+	};
+}
+
+#endif /* __MPM_KERNELS_H__ */
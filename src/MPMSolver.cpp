@@ -0,0 +1,386 @@
+#include "MPMSolver.h"
+
+#include <core/TellusimLog.h>
+
+/*
+ */
+#define CFL				0.5f
+
+/*
+ */
+namespace Mpm {
+
+	/*
+	 */
+	MPMSolver::MPMSolver() {
+
+	}
+
+	MPMSolver::~MPMSolver() {
+
+	}
+
+	/*
+	 */
+	void MPMSolver::clear() {
+		async = nullptr;
+		size = 0;
+		grid_min = Vector3f(0.0f);
+		grid_max = Vector3f(0.0f);
+		grid_size = Vector3u(0u);
+		dx = 0.0f;
+		inv_dx = 0.0f;
+		grid.clear();
+		num_substeps = 1;
+		dt = 0.0f;
+		particles.clear();
+		order.clear();
+		for(uint32_t i = 0; i < 3; i++) {
+			affine[i].clear();
+		}
+		volumes.clear();
+		num_bins = Vector3u(0u);
+		slab_indices.clear();
+		bin_offsets.clear();
+		particle_bins.clear();
+	}
+
+	/*
+	 */
+	bool MPMSolver::create(Async &a, uint32_t s, const Vector3f &min, const Vector3f &max, float32_t spacing) {
+
+		clear();
+
+		// check parameters
+		if(s == 0) {
+			TS_LOG(Error, "MPMSolver::create(): invalid size\n");
+			return false;
+		}
+		if(spacing <= 0.0f) {
+			TS_LOGF(Error, "MPMSolver::create(): invalid grid spacing %f\n", spacing);
+			return false;
+		}
+		Vector3f extent = (max - min) / spacing;
+		if(extent.x < 3.0f || extent.y < 3.0f || extent.z < 3.0f) {
+			TS_LOGF(Error, "MPMSolver::create(): grid %fx%fx%f is smaller than the stencil\n", extent.x, extent.y, extent.z);
+			return false;
+		}
+		if(!a.isInitialized() && !a.init()) {
+			TS_LOG(Error, "MPMSolver::create(): can't initialize async\n");
+			return false;
+		}
+
+		async = &a;
+		size = s;
+
+		// background grid nodes
+		grid_min = min;
+		grid_max = max;
+		dx = spacing;
+		inv_dx = 1.0f / spacing;
+		grid_size = Vector3u(ceil(extent)) + Vector3u(1u);
+		if(!grid.create(grid_size)) return false;
+
+		// particle state
+		if(!particles.create(size)) return false;
+		order.resize(size);
+		for(uint32_t i = 0; i < size; i++) order[i] = i;
+		for(uint32_t i = 0; i < 3; i++) {
+			affine[i].resize(size);
+		}
+		volumes.resize(size);
+
+		// particle slabs
+		num_bins = Vector3u((grid_size.x + SlabSize - 1) / SlabSize, (grid_size.y + SlabSize - 1) / SlabSize, (grid_size.z + SlabSize - 1) / SlabSize);
+		slab_indices.resize(size);
+		bin_offsets.resize(num_bins.x * num_bins.y * num_bins.z);
+		particle_bins.resize(size);
+
+		return true;
+	}
+
+	/*
+	 */
+	void MPMSolver::setParticles(const ParticleStore &store) {
+		TS_ASSERT(store.getSize() == size);
+		particles.copy(store);
+		for(uint32_t i = 0; i < 3; i++) {
+			for(Vector3f &row : affine[i]) row = Vector3f(0.0f);
+		}
+		for(float32_t &volume : volumes) volume = 1.0f;
+
+		// rest density is the particle mass per particle volume
+		particles.setChannel(ParticleStore::ChannelDensity, particles.get(ParticleStore::ChannelMass));
+		particles.fill(ParticleStore::ChannelPressure, 0.0f);
+	}
+
+	void MPMSolver::setInteraction(const Vector4f &i) {
+		interaction = i;
+	}
+
+	/*
+	 */
+	void MPMSolver::dispatch(float32_t ifps, const PhysicsParameters &p) {
+
+		physics = p;
+
+		// substeps of the CFL condition, waves travel at the sound speed on top of the particle velocity
+		// particles carry half of the node size along each axis, dx^3 / 8 of volume, and their mass as the rest density
+		const float32_t *mass = particles.get(ParticleStore::ChannelMass);
+		float32_t min_density = 1e16f;
+		float32_t max_speed2 = 0.0f;
+		for(uint32_t i = 0; i < size; i++) {
+			min_density = min(min_density, mass[i]);
+			max_speed2 = max(max_speed2, length2(particles.getVelocity(i)));
+		}
+		float32_t sound_speed = Tellusim::sqrt(physics.stiffness / max(min_density, 1e-6f));
+		float32_t max_speed = sound_speed + Tellusim::sqrt(max_speed2);
+		num_substeps = max(min_substeps, (uint32_t)ceil(ifps * max_speed / (CFL * dx)));
+		dt = ifps / num_substeps;
+
+		for(uint32_t i = 0; i < num_substeps; i++) {
+
+			// particle to grid
+			update_slabs();
+			for(slab_phase = 0; slab_phase < 2; slab_phase++) {
+				dispatch_pass(&MPMSolver::update_scatter, (num_bins.z + 1 - slab_phase) / 2, 1);
+			}
+
+			// grid update
+			dispatch_pass(&MPMSolver::update_blocks, grid.getNumBlocks(), 16);
+
+			// grid to particle
+			dispatch_pass(&MPMSolver::update_gather, bin_offsets.size(), 64);
+		}
+	}
+
+	/*
+	 */
+	void MPMSolver::dispatch_pass(void (MPMSolver::*func)(uint32_t, uint32_t), uint32_t num, uint32_t step) {
+
+		// split items into several chunks per thread for load balancing
+		uint32_t num_tasks = async->getNumThreads() * 4;
+		step = max((num + num_tasks - 1) / num_tasks, step);
+
+		Array<Async::Task> tasks;
+		for(uint32_t begin = 0; begin < num; begin += step) {
+			tasks.append(async->run(makeClassFunction(this, func, begin, min(begin + step, num))));
+		}
+		async->wait(tasks);
+	}
+
+	/*
+	 */
+	Vector3u MPMSolver::get_base(const Vector3f &position, Vector3f &fx) const {
+		Vector3f index = (position - grid_min) * inv_dx;
+		Vector3f base = clamp(floor(index - Vector3f(0.5f)), Vector3f(0.0f), Vector3f(grid_size - Vector3u(3u)));
+		fx = index - base;
+		return Vector3u(base);
+	}
+
+	/*
+	 */
+	void MPMSolver::update_slabs() {
+
+		// stable counting sort of the particles by the block of their stencil base
+		for(uint32_t &offset : bin_offsets) offset = 0;
+		for(uint32_t i = 0; i < size; i++) {
+			Vector3f fx;
+			Vector3u base = get_base(particles.getPosition(i), fx);
+			uint32_t bin = num_bins.x * (num_bins.y * (base.z / SlabSize) + base.y / SlabSize) + base.x / SlabSize;
+			particle_bins[i] = bin;
+			bin_offsets[bin]++;
+		}
+
+		uint32_t offset = 0;
+		for(uint32_t &bin_offset : bin_offsets) {
+			uint32_t count = bin_offset;
+			bin_offset = offset;
+			offset += count;
+		}
+
+		// bin offsets are the end offsets of the bins after the sort
+		for(uint32_t i = 0; i < size; i++) {
+			slab_indices[bin_offsets[particle_bins[i]]++] = i;
+		}
+
+		// activate the blocks of the particle stencils in the block order
+		grid.reset();
+		for(uint32_t i = 0; i < size; i++) {
+			Vector3f fx;
+			grid.activate(get_base(particles.getPosition(slab_indices[i]), fx));
+		}
+	}
+
+	void MPMSolver::update_scatter(uint32_t begin, uint32_t end) {
+
+		const float32_t *mass = particles.get(ParticleStore::ChannelMass);
+		const float32_t volume = dx * dx * dx * 0.125f;
+		const uint32_t slab_bins = num_bins.x * num_bins.y;
+		Vector4f nodes[WindowNodes];
+
+		for(uint32_t s = begin; s < end; s++) {
+			uint32_t slab = s * 2 + slab_phase;
+			for(uint32_t bin = slab_bins * slab; bin < slab_bins * (slab + 1); bin++) {
+				uint32_t bin_begin = (bin) ? bin_offsets[bin - 1] : 0;
+				uint32_t bin_end = bin_offsets[bin];
+				if(bin_begin == bin_end) continue;
+
+				// particles of the bin are accumulated in the window and added to the blocks once
+				Vector3u block = get_bin_block(bin);
+				Vector3u origin = block * (uint32_t)SparseGrid::BlockSize;
+				for(Vector4f &node : nodes) node = Vector4f(0.0f);
+
+				for(uint32_t i = bin_begin; i < bin_end; i++) {
+					uint32_t id = slab_indices[i];
+
+					Vector3f fx;
+					Vector3u base = get_base(particles.getPosition(id), fx) - origin;
+
+					// quadratic B-spline weights
+					Vector3f w[3] = {
+						Vector3f(0.5f) * (Vector3f(1.5f) - fx) * (Vector3f(1.5f) - fx),
+						Vector3f(0.75f) - (fx - Vector3f(1.0f)) * (fx - Vector3f(1.0f)),
+						Vector3f(0.5f) * (fx - Vector3f(0.5f)) * (fx - Vector3f(0.5f)),
+					};
+
+					// fluid pressure from the volume change and the APIC affine momentum
+					float32_t particle_mass = mass[id] * volume;
+					float32_t stress = -dt * 4.0f * inv_dx * inv_dx * physics.stiffness * volume * (volumes[id] - 1.0f);
+					Vector3f momentum = particles.getVelocity(id) * particle_mass;
+					Vector3f affine_x = affine[0][id] * particle_mass + Vector3f(stress, 0.0f, 0.0f);
+					Vector3f affine_y = affine[1][id] * particle_mass + Vector3f(0.0f, stress, 0.0f);
+					Vector3f affine_z = affine[2][id] * particle_mass + Vector3f(0.0f, 0.0f, stress);
+
+					for(uint32_t z = 0; z < 3; z++) {
+						for(uint32_t y = 0; y < 3; y++) {
+							Vector4f *row = nodes + WindowSize * (WindowSize * (base.z + z) + base.y + y) + base.x;
+							for(uint32_t x = 0; x < 3; x++) {
+								Vector3f delta = (Vector3f((float32_t)x, (float32_t)y, (float32_t)z) - fx) * dx;
+								float32_t weight = w[x].x * w[y].y * w[z].z;
+								Vector3f value = momentum + Vector3f(dot(affine_x, delta), dot(affine_y, delta), dot(affine_z, delta));
+								row[x] += Vector4f(value * weight, particle_mass * weight);
+							}
+						}
+					}
+				}
+
+				grid.addWindow(block, nodes, WindowSize);
+			}
+		}
+	}
+
+	/*
+	 */
+	void MPMSolver::update_blocks(uint32_t begin, uint32_t end) {
+
+		const float32_t sphere_radius = 0.6f;
+		const float32_t box_size = physics.box_size;
+
+		for(uint32_t i = begin; i < end; i++) {
+			SparseGrid::Block &block = grid.getBlock(i);
+			Vector3u origin = grid.getBlockCoord(i) * (uint32_t)SparseGrid::BlockSize;
+			for(uint32_t j = 0; j < SparseGrid::BlockNodes; j++) {
+				Vector4f &node = block.nodes[j];
+				if(node.w <= 0.0f) continue;
+
+				// momentum to velocity
+				Vector3f velocity = Vector3f(node) / node.w;
+				velocity.z += dt * physics.gravity;
+
+				// box walls and floor, the box is open at the top
+				Vector3u index = origin + Vector3u(j & SparseGrid::BlockMask, (j >> SparseGrid::BlockBits) & SparseGrid::BlockMask, j >> (SparseGrid::BlockBits * 2));
+				Vector3f position = grid_min + Vector3f(index) * dx;
+				if(position.x < -box_size) velocity.x = max(velocity.x, 0.0f);
+				if(position.x > box_size) velocity.x = min(velocity.x, 0.0f);
+				if(position.y < -box_size) velocity.y = max(velocity.y, 0.0f);
+				if(position.y > box_size) velocity.y = min(velocity.y, 0.0f);
+				if(position.z < 0.0f) velocity.z = max(velocity.z, 0.0f);
+
+				// interaction sphere
+				if(interaction.w == 1.0f) {
+					Vector3f direction = position - Vector3f(interaction);
+					float32_t distance = length(direction);
+					if(distance < sphere_radius && distance > 1e-4f) {
+						Vector3f normal = direction / distance;
+						velocity -= normal * min(dot(velocity, normal), 0.0f);
+					}
+				}
+
+				node = Vector4f(velocity, node.w);
+			}
+		}
+	}
+
+	/*
+	 */
+	void MPMSolver::update_gather(uint32_t begin, uint32_t end) {
+
+		const float32_t *mass = particles.get(ParticleStore::ChannelMass);
+		float32_t *density = particles.get(ParticleStore::ChannelDensity);
+		float32_t *pressure = particles.get(ParticleStore::ChannelPressure);
+		const Vector3f position_min = Vector3f(-physics.box_size, -physics.box_size, 0.0f);
+		const Vector3f position_max = Vector3f(physics.box_size, physics.box_size, grid_max.z - dx * 2.0f);
+		Vector4f nodes[WindowNodes];
+
+		for(uint32_t bin = begin; bin < end; bin++) {
+			uint32_t bin_begin = (bin) ? bin_offsets[bin - 1] : 0;
+			uint32_t bin_end = bin_offsets[bin];
+			if(bin_begin == bin_end) continue;
+
+			// particles of the bin read the nodes from one window
+			Vector3u block = get_bin_block(bin);
+			Vector3u origin = block * (uint32_t)SparseGrid::BlockSize;
+			grid.getWindow(block, nodes, WindowSize);
+
+			for(uint32_t i = bin_begin; i < bin_end; i++) {
+				uint32_t id = slab_indices[i];
+
+				Vector3f position = particles.getPosition(id);
+				Vector3f fx;
+				Vector3u base = get_base(position, fx) - origin;
+
+				// quadratic B-spline weights
+				Vector3f w[3] = {
+					Vector3f(0.5f) * (Vector3f(1.5f) - fx) * (Vector3f(1.5f) - fx),
+					Vector3f(0.75f) - (fx - Vector3f(1.0f)) * (fx - Vector3f(1.0f)),
+					Vector3f(0.5f) * (fx - Vector3f(0.5f)) * (fx - Vector3f(0.5f)),
+				};
+
+				// velocity and APIC affine velocity from the nodes
+				Vector3f velocity = Vector3f(0.0f);
+				Vector3f affine_x = Vector3f(0.0f);
+				Vector3f affine_y = Vector3f(0.0f);
+				Vector3f affine_z = Vector3f(0.0f);
+				for(uint32_t z = 0; z < 3; z++) {
+					for(uint32_t y = 0; y < 3; y++) {
+						const Vector4f *row = nodes + WindowSize * (WindowSize * (base.z + z) + base.y + y) + base.x;
+						for(uint32_t x = 0; x < 3; x++) {
+							Vector3f delta = (Vector3f((float32_t)x, (float32_t)y, (float32_t)z) - fx) * dx;
+							float32_t weight = w[x].x * w[y].y * w[z].z;
+							Vector3f node_velocity = Vector3f(row[x]) * weight;
+							velocity += node_velocity;
+							affine_x += delta * node_velocity.x;
+							affine_y += delta * node_velocity.y;
+							affine_z += delta * node_velocity.z;
+						}
+					}
+				}
+				float32_t scale = 4.0f * inv_dx * inv_dx;
+				affine[0][id] = affine_x * scale;
+				affine[1][id] = affine_y * scale;
+				affine[2][id] = affine_z * scale;
+
+				// advect and keep the particles inside of the box and the grid stencil
+				position = clamp(position + velocity * dt, position_min, position_max);
+				particles.setPosition(id, position);
+				particles.setVelocity(id, velocity);
+
+				// volume change from the affine velocity divergence
+				volumes[id] *= 1.0f + dt * (affine_x.x + affine_y.y + affine_z.z) * scale;
+				density[id] = mass[id] / volumes[id];
+				pressure[id] = physics.stiffness * (1.0f - volumes[id]);
+			}
+		}
+	}
+}
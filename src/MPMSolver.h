@@ -0,0 +1,128 @@
+#ifndef __MPM_MPM_SOLVER_H__
+#define __MPM_MPM_SOLVER_H__
+
+#include <core/TellusimArray.h>
+#include <core/TellusimAsync.h>
+#include <math/TellusimMath.h>
+
+#include "Parameters.h"
+#include "ParticleStore.h"
+#include "SparseGrid.h"
+
+/*
+ */
+namespace Mpm {
+
+	/**
+	 * MPMSolver class
+	 * Multithreaded MLS-MPM reference with APIC transfers and a weakly compressible fluid
+	 */
+	class MPMSolver {
+
+		public:
+
+			MPMSolver();
+			~MPMSolver();
+
+			/// clear solver
+			void clear();
+
+			/// create solver
+			/// \param async Async task scheduler used for the particle and grid passes.
+			/// \param size Number of particles.
+			/// \param grid_min Minimum corner of the background grid.
+			/// \param grid_max Maximum corner of the background grid.
+			/// \param spacing Background grid node spacing.
+			bool create(Async &async, uint32_t size, const Vector3f &grid_min, const Vector3f &grid_max, float32_t spacing);
+
+			/// set particle state, affine velocities and volumes are reset
+			void setParticles(const ParticleStore &particles);
+
+			/// interaction sphere (w is 1 when active)
+			void setInteraction(const Vector4f &interaction);
+
+			/// minimum number of substeps, more are taken when the sound speed plus the particle speed exceeds the grid CFL limit
+			TS_INLINE void setSubsteps(uint32_t s) { min_substeps = max(s, 1u); }
+			TS_INLINE uint32_t getSubsteps() const { return num_substeps; }
+
+			/// simulate one step
+			/// particle to grid, grid update and grid to particle passes for every substep
+			/// \param physics Box walls, gravity and the equation of state stiffness, the SPH kernel parameters are not used.
+			void dispatch(float32_t ifps, const PhysicsParameters &physics);
+
+			/// particle state in the loaded order
+			TS_INLINE uint32_t getSize() const { return size; }
+			TS_INLINE const ParticleStore &getParticles() const { return particles; }
+			TS_INLINE const Array<uint32_t> &getOrder() const { return order; }
+
+			/// hash of the particle state
+			TS_INLINE uint64_t getStateHash() const { return particles.getHash(); }
+
+			/// background grid, only the blocks touched by the particles of the last substep are allocated
+			TS_INLINE const Vector3u &getGridSize() const { return grid_size; }
+			TS_INLINE const SparseGrid &getGrid() const { return grid; }
+
+		private:
+
+			/// run the pass over all threads
+			void dispatch_pass(void (MPMSolver::*func)(uint32_t, uint32_t), uint32_t size, uint32_t step);
+
+			/// particle to grid scatter
+			/// slabs of the same parity never touch the same blocks and run in parallel.
+			/// particles of one bin are accumulated in a dense window of the 2x2x2 blocks around the bin block.
+			void update_slabs();
+			void update_scatter(uint32_t begin, uint32_t end);
+
+			/// grid velocity update of the active blocks
+			void update_blocks(uint32_t begin, uint32_t end);
+
+			/// grid to particle gather of the bins
+			void update_gather(uint32_t begin, uint32_t end);
+
+			/// quadratic B-spline stencil of the particle
+			TS_INLINE Vector3u get_base(const Vector3f &position, Vector3f &fx) const;
+
+			/// block of the bin
+			TS_INLINE Vector3u get_bin_block(uint32_t bin) const { return Vector3u(bin % num_bins.x, (bin / num_bins.x) % num_bins.y, bin / (num_bins.x * num_bins.y)); }
+
+			Async *async = nullptr;
+
+			uint32_t size = 0;
+			Vector4f interaction = Vector4f(0.0f);
+
+			// background grid
+			Vector3f grid_min = Vector3f(0.0f);
+			Vector3f grid_max = Vector3f(0.0f);
+			Vector3u grid_size = Vector3u(0u);
+			float32_t dx = 0.0f;
+			float32_t inv_dx = 0.0f;
+			SparseGrid grid;					// node momentum or velocity and mass
+
+			// solver parameters
+			PhysicsParameters physics;
+			uint32_t min_substeps = 1;
+			uint32_t num_substeps = 1;
+			float32_t dt = 0.0f;
+
+			// particle state
+			ParticleStore particles;
+			Array<uint32_t> order;				// identity, particles are never reordered
+			Array<Vector3f> affine[3];			// APIC affine velocity rows
+			Array<float32_t> volumes;			// deformation gradient determinant
+
+			// particles sorted by the block of their stencil base
+			// bins are z-major and every slab of one block layer is a contiguous range of bins
+			enum {
+				SlabSize = SparseGrid::BlockSize,
+				WindowSize = SparseGrid::BlockSize + 2,
+				WindowNodes = WindowSize * WindowSize * WindowSize,
+			};
+			Vector3u num_bins = Vector3u(0u);
+			uint32_t slab_phase = 0;
+			Array<uint32_t> slab_indices;
+			Array<uint32_t> bin_offsets;		// bin end offsets in the sorted indices
+			Array<uint32_t> particle_bins;
+	};
+}
+
+#endif /* __MPM_MPM_SOLVER_H__ */
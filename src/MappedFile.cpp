@@ -0,0 +1,119 @@
+#include "MappedFile.h"
+
+#include <core/TellusimLog.h>
+
+#if _WIN32
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <cstdio>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+/*
+ */
+namespace Mpm {
+
+	/*
+	 */
+	MappedFile::MappedFile() {
+
+	}
+
+	MappedFile::~MappedFile() {
+		clear();
+	}
+
+	/*
+	 */
+	void MappedFile::clear() {
+		if(data) {
+			#if _WIN32
+				UnmapViewOfFile(data);
+			#else
+				munmap((void*)data, size);
+			#endif
+		}
+		data = nullptr;
+		size = 0;
+	}
+
+	/*
+	 */
+	bool MappedFile::open(const char *name) {
+
+		clear();
+
+		// the view keeps the mapping alive after the handles are closed
+		#if _WIN32
+			HANDLE file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if(file == INVALID_HANDLE_VALUE) {
+				TS_LOGF(Error, "MappedFile::open(): can't open \"%s\" file\n", name);
+				return false;
+			}
+			LARGE_INTEGER file_size = {};
+			if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+				TS_LOGF(Error, "MappedFile::open(): \"%s\" file is empty\n", name);
+				CloseHandle(file);
+				return false;
+			}
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+			CloseHandle(file);
+			if(!mapping) {
+				TS_LOGF(Error, "MappedFile::open(): can't map \"%s\" file\n", name);
+				return false;
+			}
+			data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+			CloseHandle(mapping);
+			if(!data) {
+				TS_LOGF(Error, "MappedFile::open(): can't map \"%s\" file\n", name);
+				return false;
+			}
+			size = (size_t)file_size.QuadPart;
+		#else
+			int32_t file = ::open(name, O_RDONLY);
+			if(file < 0) {
+				TS_LOGF(Error, "MappedFile::open(): can't open \"%s\" file\n", name);
+				return false;
+			}
+			struct stat info = {};
+			if(fstat(file, &info) != 0 || info.st_size == 0) {
+				TS_LOGF(Error, "MappedFile::open(): \"%s\" file is empty\n", name);
+				close(file);
+				return false;
+			}
+			void *ptr = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			close(file);
+			if(ptr == MAP_FAILED) {
+				TS_LOGF(Error, "MappedFile::open(): can't map \"%s\" file\n", name);
+				return false;
+			}
+			data = (uint8_t*)ptr;
+			size = (size_t)info.st_size;
+		#endif
+
+		return true;
+	}
+
+	/*
+	 */
+	String MappedFile::getTempName(const char *name) {
+		#if _WIN32
+			uint32_t process = (uint32_t)GetCurrentProcessId();
+		#else
+			uint32_t process = (uint32_t)getpid();
+		#endif
+		return String::format("%s.%u.tmp", name, process);
+	}
+
+	bool MappedFile::replace(const char *src, const char *dest) {
+		#if _WIN32
+			return (MoveFileExA(src, dest, MOVEFILE_REPLACE_EXISTING) != 0);
+		#else
+			return (::rename(src, dest) == 0);
+		#endif
+	}
+}
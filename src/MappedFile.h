@@ -0,0 +1,54 @@
+#ifndef __MPM_MAPPED_FILE_H__
+#define __MPM_MAPPED_FILE_H__
+
+#include <TellusimBase.h>
+#include <core/TellusimString.h>
+
+/*
+ */
+namespace Mpm {
+
+	using namespace Tellusim;
+
+	/**
+	 * MappedFile class
+	 * Copy-on-write memory mapping of a whole file, the pages are loaded by the system on first access
+	 * and modified pages are private to the process
+	 */
+	class MappedFile {
+
+		public:
+
+			MappedFile();
+			~MappedFile();
+
+			/// unmap file
+			void clear();
+
+			/// map file
+			bool open(const char *name);
+
+			/// mapped data
+			TS_INLINE bool isOpened() const { return (data != nullptr); }
+			TS_INLINE uint8_t *getData() { return data; }
+			TS_INLINE const uint8_t *getData() const { return data; }
+			TS_INLINE size_t getSize() const { return size; }
+
+			/// temporary file name of the process next to the file
+			static String getTempName(const char *name);
+
+			/// replace the file by a completely written file
+			/// mappings of the replaced file keep their pages instead of observing a truncated file.
+			static bool replace(const char *src, const char *dest);
+
+		private:
+
+			MappedFile(const MappedFile&) = delete;
+			MappedFile &operator=(const MappedFile&) = delete;
+
+			uint8_t *data = nullptr;
+			size_t size = 0;
+	};
+}
+
+#endif /* __MPM_MAPPED_FILE_H__ */
@@ -0,0 +1,49 @@
+#ifndef __MPM_PARAMETERS_H__
+#define __MPM_PARAMETERS_H__
+
+#include <TellusimTypes.h>
+#include <math/TellusimMath.h>
+
+/*
+ */
+namespace Mpm {
+
+	using namespace Tellusim;
+
+	/**
+	 * Physical parameters of the SPH fluid
+	 * The defaults are the constants of the original shaders
+	 */
+	struct PhysicsParameters {
+		float32_t stiffness = 10.0f;		// equation of state stiffness
+		float32_t rest_density = 1.0f;		// equation of state rest density
+		float32_t density_length = 1.0f;	// poly6 density kernel length
+		float32_t viscosity = 0.018f;
+		float32_t smoothing_length = 0.4f;	// pressure and viscosity kernel length
+		float32_t box_size = 5.0f;			// half size of the box walls
+		float32_t gravity = -2.5f;
+		uint32_t kernel = 0;				// KernelType of the CPU incompressible solvers, padding of the shaders
+	};
+
+	/**
+	 * Compute parameters shared by the compute shaders and the CPU solver
+	 * The layout must match the ComputeParameters uniform block of main.comp and pressureDensity.comp
+	 */
+	struct ComputeParameters {
+		uint32_t size;
+		float32_t ifps;
+		float32_t radius;
+		float32_t grid_scale;
+		Vector3f grid_origin;		// minimum corner of the bounded grid
+		uint32_t ranges_offset;
+		Vector3u grid_size;			// number of cells along each axis
+		uint32_t stencil_size;		// number of neighbor cells along each axis
+		float32_t hash_offset;		// cell offset of the particle hashes
+		float32_t stencil_offset;	// cell offset of the first neighbor cell
+		uint32_t padding_0;
+		uint32_t padding_1;
+		PhysicsParameters physics;
+	};
+}
+
+#endif /* __MPM_PARAMETERS_H__ */
@@ -0,0 +1,154 @@
+#include "ParticleStore.h"
+
+#include <core/TellusimLog.h>
+
+/*
+ */
+namespace Mpm {
+
+	/*
+	 */
+	ParticleStore::ParticleStore() {
+
+	}
+
+	ParticleStore::~ParticleStore() {
+
+	}
+
+	/*
+	 */
+	void ParticleStore::clear() {
+		size = 0;
+		capacity = 0;
+		data.clear();
+		for(uint32_t i = 0; i < NumChannels; i++) {
+			channels[i] = nullptr;
+		}
+	}
+
+	/*
+	 */
+	bool ParticleStore::create(uint32_t s) {
+
+		clear();
+
+		if(s == 0) {
+			TS_LOG(Error, "ParticleStore::create(): invalid size\n");
+			return false;
+		}
+
+		// one block for all channels with an extra alignment pad
+		uint64_t new_capacity = ((uint64_t)s + Width - 1) & ~(uint64_t)(Width - 1);
+		size_t channel_bytes = sizeof(float32_t) * new_capacity;
+		if(channel_bytes * NumChannels + Alignment > Maxu32) {
+			TS_LOGF(Error, "ParticleStore::create(): too many particles %u\n", s);
+			return false;
+		}
+		size = s;
+		capacity = (uint32_t)new_capacity;
+		data.resize((uint32_t)(channel_bytes * NumChannels + Alignment));
+		uint8_t *base = data.get() + ((Alignment - ((size_t)data.get() & (Alignment - 1))) & (Alignment - 1));
+		for(uint32_t i = 0; i < NumChannels; i++) {
+			channels[i] = (float32_t*)(base + channel_bytes * i);
+		}
+
+		// padding lanes are zero so they never contribute mass
+		memset(base, 0, channel_bytes * NumChannels);
+
+		return true;
+	}
+
+	/*
+	 */
+	void ParticleStore::copy(const ParticleStore &store) {
+		if(capacity != store.capacity) create(store.size);
+		size = store.size;
+		for(uint32_t i = 0; i < NumChannels; i++) {
+			memcpy(channels[i], store.channels[i], sizeof(float32_t) * capacity);
+		}
+	}
+
+	void ParticleStore::swap(ParticleStore &store) {
+		Tellusim::swap(size, store.size);
+		Tellusim::swap(capacity, store.capacity);
+		data.swap(store.data);
+		for(uint32_t i = 0; i < NumChannels; i++) {
+			Tellusim::swap(channels[i], store.channels[i]);
+		}
+	}
+
+	/*
+	 */
+	void ParticleStore::fill(Channel channel, float32_t value) {
+		float32_t *TS_RESTRICT dest = channels[channel];
+		for(uint32_t i = 0; i < size; i++) {
+			dest[i] = value;
+		}
+	}
+
+	/*
+	 */
+	void ParticleStore::setPositions(const Vector4f *positions) {
+		float32_t *TS_RESTRICT x = channels[ChannelX];
+		float32_t *TS_RESTRICT y = channels[ChannelY];
+		float32_t *TS_RESTRICT z = channels[ChannelZ];
+		for(uint32_t i = 0; i < size; i++) {
+			x[i] = positions[i].x;
+			y[i] = positions[i].y;
+			z[i] = positions[i].z;
+		}
+	}
+
+	void ParticleStore::setVelocities(const Vector4f *velocities) {
+		float32_t *TS_RESTRICT vx = channels[ChannelVX];
+		float32_t *TS_RESTRICT vy = channels[ChannelVY];
+		float32_t *TS_RESTRICT vz = channels[ChannelVZ];
+		for(uint32_t i = 0; i < size; i++) {
+			vx[i] = velocities[i].x;
+			vy[i] = velocities[i].y;
+			vz[i] = velocities[i].z;
+		}
+	}
+
+	void ParticleStore::getPositions(Vector4f *positions) const {
+		const float32_t *TS_RESTRICT x = channels[ChannelX];
+		const float32_t *TS_RESTRICT y = channels[ChannelY];
+		const float32_t *TS_RESTRICT z = channels[ChannelZ];
+		for(uint32_t i = 0; i < size; i++) {
+			positions[i].set(x[i], y[i], z[i], 0.0f);
+		}
+	}
+
+	void ParticleStore::getVelocities(Vector4f *velocities) const {
+		const float32_t *TS_RESTRICT vx = channels[ChannelVX];
+		const float32_t *TS_RESTRICT vy = channels[ChannelVY];
+		const float32_t *TS_RESTRICT vz = channels[ChannelVZ];
+		for(uint32_t i = 0; i < size; i++) {
+			velocities[i].set(vx[i], vy[i], vz[i], 0.0f);
+		}
+	}
+
+	void ParticleStore::setChannel(Channel channel, const float32_t *src) {
+		memcpy(channels[channel], src, sizeof(float32_t) * size);
+	}
+
+	void ParticleStore::getChannel(Channel channel, float32_t *dest) const {
+		memcpy(dest, channels[channel], sizeof(float32_t) * size);
+	}
+
+	/*
+	 */
+	uint64_t ParticleStore::getHash(const uint32_t *indices) const {
+		uint64_t ret = 0xcbf29ce484222325ull;
+		for(uint32_t i = 0; i < NumChannels; i++) {
+			const uint32_t *TS_RESTRICT src = (const uint32_t*)channels[i];
+			if(indices) {
+				for(uint32_t j = 0; j < size; j++) ret = (ret ^ src[indices[j]]) * 0x100000001b3ull;
+			} else {
+				for(uint32_t j = 0; j < size; j++) ret = (ret ^ src[j]) * 0x100000001b3ull;
+			}
+		}
+		return ret;
+	}
+}
@@ -0,0 +1,98 @@
+#ifndef __MPM_PARTICLE_STORE_H__
+#define __MPM_PARTICLE_STORE_H__
+
+#include <core/TellusimArray.h>
+#include <math/TellusimMath.h>
+
+/*
+ */
+namespace Mpm {
+
+	using namespace Tellusim;
+
+	/**
+	 * ParticleStore class
+	 * Structure-of-arrays particle channels aligned and padded to float32x8_t boundaries
+	 */
+	class ParticleStore {
+
+		public:
+
+			/// Particle channels
+			enum Channel {
+				ChannelX = 0,
+				ChannelY,
+				ChannelZ,
+				ChannelVX,
+				ChannelVY,
+				ChannelVZ,
+				ChannelDensity,
+				ChannelPressure,
+				ChannelMass,
+				NumChannels,
+			};
+
+			enum {
+				Width = 8,			// float32x8_t lanes
+				Alignment = 32,		// float32x8_t alignment in bytes
+			};
+
+			ParticleStore();
+			~ParticleStore();
+
+			/// clear store
+			void clear();
+
+			/// create store
+			/// \param size Number of particles, channels are padded to the Width boundary.
+			bool create(uint32_t size);
+
+			/// copy store
+			void copy(const ParticleStore &store);
+
+			/// swap stores
+			void swap(ParticleStore &store);
+
+			/// store parameters
+			TS_INLINE uint32_t getSize() const { return size; }
+			TS_INLINE uint32_t getCapacity() const { return capacity; }
+
+			/// channel data
+			TS_INLINE float32_t *get(Channel channel) { return channels[channel]; }
+			TS_INLINE const float32_t *get(Channel channel) const { return channels[channel]; }
+
+			/// fill channel, padding lanes are left untouched
+			void fill(Channel channel, float32_t value);
+
+			/// interleaved conversion
+			void setPositions(const Vector4f *positions);
+			void setVelocities(const Vector4f *velocities);
+			void getPositions(Vector4f *positions) const;
+			void getVelocities(Vector4f *velocities) const;
+			void setChannel(Channel channel, const float32_t *src);
+			void getChannel(Channel channel, float32_t *dest) const;
+
+			/// 64-bit FNV-1a hash of the channel bits
+			/// \param indices Particle indices in the hashed order, the store order is used when it is null.
+			uint64_t getHash(const uint32_t *indices = nullptr) const;
+
+			/// particle accessors
+			TS_INLINE Vector3f getPosition(uint32_t index) const { return Vector3f(channels[ChannelX][index], channels[ChannelY][index], channels[ChannelZ][index]); }
+			TS_INLINE Vector3f getVelocity(uint32_t index) const { return Vector3f(channels[ChannelVX][index], channels[ChannelVY][index], channels[ChannelVZ][index]); }
+			TS_INLINE void setPosition(uint32_t index, const Vector3f &p) { channels[ChannelX][index] = p.x; channels[ChannelY][index] = p.y; channels[ChannelZ][index] = p.z; }
+			TS_INLINE void setVelocity(uint32_t index, const Vector3f &v) { channels[ChannelVX][index] = v.x; channels[ChannelVY][index] = v.y; channels[ChannelVZ][index] = v.z; }
+
+		private:
+
+			ParticleStore(const ParticleStore&) = delete;
+			ParticleStore &operator=(const ParticleStore&) = delete;
+
+			uint32_t size = 0;
+			uint32_t capacity = 0;
+
+			Array<uint8_t> data;
+			float32_t *channels[NumChannels] = {};
+	};
+}
+
+#endif /* __MPM_PARTICLE_STORE_H__ */
@@ -0,0 +1,451 @@
+#include "PointCloud.h"
+#include "MappedFile.h"
+
+#include <core/TellusimLog.h>
+#include <core/TellusimFile.h>
+#include <math/TellusimSimd.h>
+
+#include <io/LasReader.hpp>
+#include <pdal/PointRef.hpp>
+#include <pdal/PointView.hpp>
+#include <pdal/PointTable.hpp>
+
+/*
+ */
+namespace Mpm {
+
+	/*
+	 */
+	PointCloud::PointCloud() {
+
+	}
+
+	PointCloud::~PointCloud() {
+
+	}
+
+	/*
+	 */
+	void PointCloud::clear() {
+		size = 0;
+		capacity = 0;
+		data.clear();
+		cache.clear();
+		for(uint32_t i = 0; i < NumChannels; i++) {
+			channels[i] = nullptr;
+		}
+	}
+
+	/*
+	 */
+	bool PointCloud::create(uint32_t s) {
+
+		clear();
+
+		if(s == 0) {
+			TS_LOG(Error, "PointCloud::create(): invalid size\n");
+			return false;
+		}
+
+		return resize(s);
+	}
+
+	bool PointCloud::resize(uint32_t s) {
+		if(s > capacity) {
+
+			// streamed clouds grow geometrically
+			if(s > MaxSize) {
+				TS_LOGF(Error, "PointCloud::resize(): too many points %u\n", s);
+				return false;
+			}
+			uint64_t new_capacity = (capacity) ? max((uint64_t)s, (uint64_t)capacity * 3 / 2) : s;
+			new_capacity = min((new_capacity + Width - 1) & ~(uint64_t)(Width - 1), (uint64_t)MaxSize);
+			size_t channel_bytes = sizeof(float32_t) * new_capacity;
+
+			// one block for all channels with an extra alignment pad
+			Array<uint8_t> new_data((uint32_t)(channel_bytes * NumChannels + Alignment));
+			uint8_t *base = new_data.get() + ((Alignment - ((size_t)new_data.get() & (Alignment - 1))) & (Alignment - 1));
+
+			// padding lanes are transformed with the points
+			memset(base, 0, channel_bytes * NumChannels);
+			for(uint32_t i = 0; i < NumChannels; i++) {
+				if(size) memcpy(base + channel_bytes * i, channels[i], sizeof(float32_t) * size);
+				channels[i] = (float32_t*)(base + channel_bytes * i);
+			}
+			data.swap(new_data);
+			cache.clear();
+			capacity = (uint32_t)new_capacity;
+		}
+		size = s;
+		return true;
+	}
+
+	/**
+	 * Streamed point table
+	 * Reader chunks are converted into the XYZ columns of the cloud when the table is cleared,
+	 * only one chunk of full point records is kept in memory
+	 */
+	class PointCloudTable : public pdal::FixedPointTable {
+
+		public:
+
+			PointCloudTable(PointCloud &cloud, uint32_t capacity) : pdal::FixedPointTable(capacity), cloud(cloud) { }
+
+			/// all chunks are converted
+			TS_INLINE bool isValid() const { return valid; }
+
+		protected:
+
+			virtual void reset() override {
+				uint32_t offset = cloud.getSize();
+				uint32_t num_points = (uint32_t)numPoints();
+				if(valid && num_points) valid = cloud.resize(offset + num_points);
+				if(valid) {
+					float32_t *TS_RESTRICT x = cloud.get(PointCloud::ChannelX) + offset;
+					float32_t *TS_RESTRICT y = cloud.get(PointCloud::ChannelY) + offset;
+					float32_t *TS_RESTRICT z = cloud.get(PointCloud::ChannelZ) + offset;
+					uint32_t size = 0;
+					for(uint32_t i = 0; i < num_points; i++) {
+						if(skip(i)) continue;
+						pdal::PointRef point(*this, i);
+						x[size] = (float32_t)point.getFieldAs<double>(pdal::Dimension::Id::X);
+						y[size] = (float32_t)point.getFieldAs<double>(pdal::Dimension::Id::Y);
+						z[size] = (float32_t)point.getFieldAs<double>(pdal::Dimension::Id::Z);
+						size++;
+					}
+					cloud.resize(offset + size);
+				}
+				pdal::FixedPointTable::reset();
+			}
+
+		private:
+
+			PointCloud &cloud;
+			bool valid = true;
+	};
+
+	/**
+	 * LAS public header fields of the native reader
+	 */
+	struct LasHeader {
+		uint32_t data_offset = 0;
+		uint32_t record_length = 0;
+		uint64_t num_points = 0;
+		float64_t scale[3] = {};
+		float64_t offset[3] = {};
+	};
+
+	template <class Type> static TS_INLINE Type read_las(const uint8_t *src) {
+		Type ret;
+		memcpy(&ret, src, sizeof(Type));
+		return ret;
+	}
+
+	/// LAS 1.0-1.4 header with uncompressed point records, other files are read by PDAL
+	static bool get_las_header(const uint8_t *data, size_t size, LasHeader &header) {
+		if(size < 227 || memcmp(data, "LASF", 4) != 0) return false;
+		if(data[24] != 1 || data[25] > 4) return false;
+		uint32_t header_size = read_las<uint16_t>(data + 94);
+		if(header_size < 227 || header_size > size) return false;
+
+		// compressed LAZ records set the high bits of the format
+		uint32_t format = data[104];
+		if(format > 10) return false;
+
+		header.data_offset = read_las<uint32_t>(data + 96);
+		header.record_length = read_las<uint16_t>(data + 105);
+		header.num_points = read_las<uint32_t>(data + 107);
+		if(data[25] >= 4 && header_size >= 375) {
+			uint64_t num_points = read_las<uint64_t>(data + 247);
+			if(num_points) header.num_points = num_points;
+		}
+		for(uint32_t i = 0; i < 3; i++) {
+			header.scale[i] = read_las<float64_t>(data + 131 + 8 * i);
+			header.offset[i] = read_las<float64_t>(data + 155 + 8 * i);
+		}
+
+		// XYZ are the first three 32-bit integers of every record format
+		if(header.record_length < 12 || header.num_points >= Maxu32) return false;
+		if(header.data_offset + header.num_points * header.record_length > size) return false;
+
+		return true;
+	}
+
+	static void decode_las_points(const uint8_t *records, const LasHeader *header, float32_t *x, float32_t *y, float32_t *z, uint32_t begin, uint32_t end) {
+
+		// double precision scale and offset of the PDAL reader
+		for(uint32_t i = begin; i < end; i++) {
+			const uint8_t *src = records + (size_t)header->record_length * i;
+			x[i] = (float32_t)(read_las<int32_t>(src + 0) * header->scale[0] + header->offset[0]);
+			y[i] = (float32_t)(read_las<int32_t>(src + 4) * header->scale[1] + header->offset[1]);
+			z[i] = (float32_t)(read_las<int32_t>(src + 8) * header->scale[2] + header->offset[2]);
+		}
+	}
+
+	/*
+	 */
+	static void decode_points(const pdal::PointView *view, float32_t *x, float32_t *y, float32_t *z, uint32_t begin, uint32_t end) {
+
+		// packed XYZ doubles of one point
+		const pdal::DimTypeList dims = {
+			pdal::DimType(pdal::Dimension::Id::X, pdal::Dimension::Type::Double),
+			pdal::DimType(pdal::Dimension::Id::Y, pdal::Dimension::Type::Double),
+			pdal::DimType(pdal::Dimension::Id::Z, pdal::Dimension::Type::Double),
+		};
+		float64_t point[3];
+		for(uint32_t i = begin; i < end; i++) {
+			view->getPackedPoint(dims, i, (char*)point);
+			x[i] = (float32_t)point[0];
+			y[i] = (float32_t)point[1];
+			z[i] = (float32_t)point[2];
+		}
+	}
+
+	bool PointCloud::load(Async &async, const char *name, const Matrix4x4f &matrix) {
+
+		clear();
+
+		if(!async.isInitialized() && !async.init()) {
+			TS_LOG(Error, "PointCloud::load(): can't initialize async\n");
+			return false;
+		}
+
+		// native reader of uncompressed LAS files
+		bool supported = false;
+		if(load_las(async, name, supported)) {
+			transform(async, matrix);
+			return true;
+		}
+		if(supported) return false;
+
+		// read .las file
+		pdal::Options options;
+		pdal::LasReader reader;
+		options.add("filename", name);
+		reader.setOptions(options);
+
+		// stream chunks into the columns
+		if(chunk_size) {
+			pdal::QuickInfo info = reader.preview();
+			if(info.valid() && info.m_pointCount > 0 && info.m_pointCount < Maxu32 && !resize((uint32_t)info.m_pointCount)) return false;
+			size = 0;
+			PointCloudTable table(*this, chunk_size);
+			reader.prepare(table);
+			reader.execute(table);
+			if(!table.isValid()) {
+				TS_LOGF(Error, "PointCloud::load(): can't stream \"%s\" file\n", name);
+				return false;
+			}
+			if(size == 0) {
+				TS_LOGF(Error, "PointCloud::load(): \"%s\" file has no points\n", name);
+				return false;
+			}
+			transform(async, matrix);
+			return true;
+		}
+
+		// decode the point view
+		pdal::PointTable table;
+		reader.prepare(table);
+		pdal::PointViewSet point_view_set = reader.execute(table);
+		if(point_view_set.empty()) {
+			TS_LOGF(Error, "PointCloud::load(): can't read \"%s\" file\n", name);
+			return false;
+		}
+		pdal::PointViewPtr view = *point_view_set.begin();
+		if(view->size() == 0 || view->size() >= Maxu32) {
+			TS_LOGF(Error, "PointCloud::load(): \"%s\" file has invalid number of points\n", name);
+			return false;
+		}
+		if(!create((uint32_t)view->size())) return false;
+
+		// decode columns, the view is read-only and shared by the tasks
+		Array<Async::Task> tasks;
+		for(uint32_t begin = 0; begin < size; begin += TaskSize) {
+			tasks.append(async.run(decode_points, view.get(), channels[ChannelX], channels[ChannelY], channels[ChannelZ], begin, min(begin + TaskSize, size)));
+		}
+		async.wait(tasks);
+
+		transform(async, matrix);
+
+		return true;
+	}
+
+	bool PointCloud::load_las(Async &async, const char *name, bool &supported) {
+
+		// the file is read in place
+		MappedFile file;
+		if(!file.open(name)) return false;
+		LasHeader header;
+		supported = get_las_header(file.getData(), file.getSize(), header);
+		if(!supported) return false;
+		if(header.num_points == 0) {
+			TS_LOGF(Error, "PointCloud::load(): \"%s\" file has no points\n", name);
+			return false;
+		}
+		if(!create((uint32_t)header.num_points)) return false;
+
+		// decode record ranges in parallel
+		const uint8_t *records = file.getData() + header.data_offset;
+		Array<Async::Task> tasks;
+		for(uint32_t begin = 0; begin < size; begin += TaskSize) {
+			tasks.append(async.run(decode_las_points, records, &header, channels[ChannelX], channels[ChannelY], channels[ChannelZ], begin, min(begin + TaskSize, size)));
+		}
+		async.wait(tasks);
+
+		return true;
+	}
+
+	/**
+	 * Point cache header, the channels follow at the data offset
+	 */
+	struct PointCacheHeader {
+		enum {
+			Magic = ('M' << 0) | ('P' << 8) | ('M' << 16) | ('C' << 24),
+			Version = 1,
+		};
+		uint32_t magic;
+		uint32_t version;
+		uint64_t source_hash;
+		float32_t transform[16];
+		uint32_t size;
+		uint32_t capacity;
+		uint32_t data_offset;				// channels at the Alignment boundary
+		uint32_t padding;
+	};
+
+	static uint64_t get_hash(uint64_t hash, const void *src, size_t size) {
+		const uint8_t *TS_RESTRICT data = (const uint8_t*)src;
+		for(size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 0x100000001b3ull;
+		return hash;
+	}
+
+	/*
+	 */
+	uint64_t PointCloud::getSourceHash(const char *name) {
+
+		// public header and the first records of the source
+		uint8_t header[4096];
+		File file;
+		if(!file.open(name, "rb")) return 0;
+		size_t header_size = file.read(header, min(file.getSize(), sizeof(header)));
+
+		// 64-bit FNV-1a
+		uint64_t file_size = file.getSize();
+		uint64_t file_time = File::getMTime(name);
+		uint64_t ret = 0xcbf29ce484222325ull;
+		ret = get_hash(ret, &file_size, sizeof(file_size));
+		ret = get_hash(ret, &file_time, sizeof(file_time));
+		ret = get_hash(ret, header, header_size);
+
+		return ret;
+	}
+
+	/*
+	 */
+	bool PointCloud::loadCache(const char *name, uint64_t source_hash, const Matrix4x4f &matrix) {
+		static_assert(sizeof(PointCacheHeader::transform) == sizeof(Matrix4x4f), "invalid transform size");
+
+		clear();
+
+		// missing caches are created by the caller
+		if(!File::isFile(name) || !cache.open(name)) return false;
+
+		// check header
+		PointCacheHeader header = {};
+		if(cache.getSize() >= sizeof(header)) memcpy(&header, cache.getData(), sizeof(header));
+		if(header.magic != PointCacheHeader::Magic || header.version != PointCacheHeader::Version || header.size == 0 || header.size > header.capacity ||
+			(header.capacity & (Width - 1)) || (header.data_offset & (Alignment - 1)) || header.data_offset < sizeof(header) ||
+			header.data_offset + sizeof(float32_t) * header.capacity * NumChannels > cache.getSize()) {
+			TS_LOGF(Warning, "PointCloud::loadCache(): invalid \"%s\" file\n", name);
+			cache.clear();
+			return false;
+		}
+		if(header.source_hash != source_hash || memcmp(header.transform, &matrix, sizeof(header.transform)) != 0) {
+			TS_LOGF(Message, "PointCloud::loadCache(): \"%s\" file is out of date\n", name);
+			cache.clear();
+			return false;
+		}
+
+		// channels are used in place
+		size = header.size;
+		capacity = header.capacity;
+		size_t channel_bytes = sizeof(float32_t) * capacity;
+		for(uint32_t i = 0; i < NumChannels; i++) {
+			channels[i] = (float32_t*)(cache.getData() + header.data_offset + channel_bytes * i);
+		}
+
+		return true;
+	}
+
+	bool PointCloud::saveCache(const char *name, uint64_t source_hash, const Matrix4x4f &matrix) const {
+
+		// the cache is written under a temporary name and renamed into place,
+		// so the processes mapping the previous cache never see a truncated file
+		String temp_name = MappedFile::getTempName(name);
+		File file;
+		if(!file.open(temp_name.get(), "wb")) {
+			TS_LOGF(Warning, "PointCloud::saveCache(): can't create \"%s\" file\n", temp_name.get());
+			return false;
+		}
+
+		// header padded to the channel alignment
+		PointCacheHeader header = {};
+		header.magic = PointCacheHeader::Magic;
+		header.version = PointCacheHeader::Version;
+		header.source_hash = source_hash;
+		memcpy(header.transform, &matrix, sizeof(header.transform));
+		header.size = size;
+		header.capacity = capacity;
+		header.data_offset = (sizeof(header) + Alignment - 1) & ~(uint32_t)(Alignment - 1);
+		uint8_t padding[Alignment] = {};
+		bool status = (file.write(&header, sizeof(header)) == sizeof(header));
+		status &= (file.write(padding, header.data_offset - sizeof(header)) == header.data_offset - sizeof(header));
+
+		// channels with the padding lanes
+		for(uint32_t i = 0; i < NumChannels && status; i++) {
+			status &= (file.write(channels[i], sizeof(float32_t) * capacity) == sizeof(float32_t) * capacity);
+		}
+		file.close();
+		if(!status) {
+			TS_LOGF(Warning, "PointCloud::saveCache(): can't write \"%s\" file\n", temp_name.get());
+			File::remove(temp_name.get());
+			return false;
+		}
+		if(!MappedFile::replace(temp_name.get(), name)) {
+			TS_LOGF(Warning, "PointCloud::saveCache(): can't replace \"%s\" file\n", name);
+			File::remove(temp_name.get());
+			return false;
+		}
+
+		return true;
+	}
+
+	/*
+	 */
+	void PointCloud::transform(Async &async, const Matrix4x4f &matrix) {
+		Array<Async::Task> tasks;
+		for(uint32_t begin = 0; begin < capacity; begin += TaskSize) {
+			tasks.append(async.run(makeClassFunction(this, &PointCloud::transform_points, &matrix, begin, min(begin + TaskSize, capacity))));
+		}
+		async.wait(tasks);
+	}
+
+	void PointCloud::transform_points(const Matrix4x4f *matrix, uint32_t begin, uint32_t end) {
+		TS_ASSERT((begin & (Width - 1)) == 0 && (end & (Width - 1)) == 0);
+
+		// same operation order as the Matrix4x4f by Vector4f multiplication with unit w
+		const Matrix4x4f &m = *matrix;
+		float32x8_t *TS_RESTRICT x = (float32x8_t*)channels[ChannelX];
+		float32x8_t *TS_RESTRICT y = (float32x8_t*)channels[ChannelY];
+		float32x8_t *TS_RESTRICT z = (float32x8_t*)channels[ChannelZ];
+		for(uint32_t i = begin / Width; i < end / Width; i++) {
+			float32x8_t px = x[i];
+			float32x8_t py = y[i];
+			float32x8_t pz = z[i];
+			x[i] = px * m.m00 + py * m.m01 + pz * m.m02 + m.m03;
+			y[i] = px * m.m10 + py * m.m11 + pz * m.m12 + m.m13;
+			z[i] = px * m.m20 + py * m.m21 + pz * m.m22 + m.m23;
+		}
+	}
+}
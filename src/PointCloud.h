@@ -0,0 +1,106 @@
+#ifndef __MPM_POINT_CLOUD_H__
+#define __MPM_POINT_CLOUD_H__
+
+#include <core/TellusimArray.h>
+#include <core/TellusimAsync.h>
+#include <math/TellusimMath.h>
+
+#include "MappedFile.h"
+
+/*
+ */
+namespace Mpm {
+
+	using namespace Tellusim;
+
+	/**
+	 * PointCloud class
+	 * Transformed input points in structure-of-arrays channels aligned and padded to float32x8_t boundaries
+	 */
+	class PointCloud {
+
+		public:
+
+			/// Point channels
+			enum Channel {
+				ChannelX = 0,
+				ChannelY,
+				ChannelZ,
+				NumChannels,
+			};
+
+			enum {
+				Width = 8,			// float32x8_t lanes
+				Alignment = 32,		// float32x8_t alignment in bytes
+				TaskSize = 1 << 16,	// points decoded by one task
+				ChunkSize = 1 << 16,	// points of one streamed chunk
+				MaxSize = (((1u << 31) - Alignment - 1) / (sizeof(float32_t) * NumChannels)) & ~(Width - 1),	// points of the channel block below 2GB
+			};
+
+			PointCloud();
+			~PointCloud();
+
+			/// clear points
+			void clear();
+
+			/// create points
+			/// \param size Number of points, channels are padded to the Width boundary.
+			bool create(uint32_t size);
+
+			/// resize points, the existing points are kept and the capacity grows geometrically up to MaxSize
+			bool resize(uint32_t size);
+
+			/// points of one streamed chunk
+			/// the reader keeps only one chunk of full point records, the whole file is read into a point view when it is zero.
+			TS_INLINE void setChunkSize(uint32_t size) { chunk_size = size; }
+			TS_INLINE uint32_t getChunkSize() const { return chunk_size; }
+
+			/// load LAS or LAZ file
+			/// uncompressed LAS point records are decoded from the memory-mapped file in parallel tasks,
+			/// other files are streamed in chunks or decoded from the PDAL point view.
+			/// XYZ columns are then transformed in place eight points at once.
+			/// \param async Async task scheduler used for the decode and transform passes.
+			/// \param transform Scene transform applied to the points.
+			bool load(Async &async, const char *name, const Matrix4x4f &transform);
+
+			/// apply the transform to all points
+			void transform(Async &async, const Matrix4x4f &transform);
+
+			/// key of the source file from its size, modification time and header bytes
+			static uint64_t getSourceHash(const char *name);
+
+			/// binary point cache with the source key, the transform and the aligned channels
+			/// loaded channels point into the copy-on-write mapping of the cache file.
+			/// \param source_hash Source file key, caches of other keys or transforms are rejected.
+			bool loadCache(const char *name, uint64_t source_hash, const Matrix4x4f &transform);
+			bool saveCache(const char *name, uint64_t source_hash, const Matrix4x4f &transform) const;
+
+			/// points
+			TS_INLINE uint32_t getSize() const { return size; }
+			TS_INLINE float32_t *get(Channel channel) { return channels[channel]; }
+			TS_INLINE const float32_t *get(Channel channel) const { return channels[channel]; }
+			TS_INLINE Vector3f getPosition(uint32_t index) const { return Vector3f(channels[ChannelX][index], channels[ChannelY][index], channels[ChannelZ][index]); }
+
+		private:
+
+			PointCloud(const PointCloud&) = delete;
+			PointCloud &operator=(const PointCloud&) = delete;
+
+			/// native LAS point records
+			bool load_las(Async &async, const char *name, bool &supported);
+
+			/// transform the points of the range, the range begins at the Width boundary
+			void transform_points(const Matrix4x4f *transform, uint32_t begin, uint32_t end);
+
+			uint32_t chunk_size = ChunkSize;
+
+			uint32_t size = 0;
+			uint32_t capacity = 0;
+
+			Array<uint8_t> data;
+			MappedFile cache;					// mapped channels of the point cache
+			float32_t *channels[NumChannels] = {};
+	};
+}
+
+#endif /* __MPM_POINT_CLOUD_H__ */
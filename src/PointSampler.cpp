@@ -0,0 +1,633 @@
+#include "PointSampler.h"
+
+#include <core/TellusimLog.h>
+
+/*
+ */
+namespace Mpm {
+
+	/*
+	 */
+	enum {
+		TaskSize = 1 << 16,			// points of one task
+		CellTaskSize = 1 << 10,		// cells of one task
+		MaxCells = 1500,			// cells along the longest axis of the Poisson-disk search
+		MaxVoxels = 1 << 30,		// voxels of the volume fill
+		SliceTaskSize = 4,			// voxel slices of one task
+	};
+
+	/// random point priority
+	static TS_INLINE uint32_t get_priority(uint32_t index) {
+		index ^= index >> 16;
+		index *= 0x7feb352du;
+		index ^= index >> 15;
+		index *= 0x846ca68bu;
+		index ^= index >> 16;
+		return index;
+	}
+
+	static TS_INLINE uint32_t get_table_hash(uint32_t key) {
+		key *= 0x9e3779b1u;
+		return key ^ (key >> 16);
+	}
+
+	/*
+	 */
+	PointSampler::PointSampler() {
+
+	}
+
+	PointSampler::~PointSampler() {
+
+	}
+
+	/*
+	 */
+	void PointSampler::clear() {
+		spacing = 0.0f;
+		task_bounds.clear();
+		grid_size = Vector3u(0u);
+		keys.clear();
+		values.clear();
+		scratch.clear();
+		cells.clear();
+		cell_table.clear();
+		table_mask = 0;
+		priorities.clear();
+		phase_cells.clear();
+		accepted.clear();
+		disks.clear();
+		voxels.clear();
+		slice_offsets.clear();
+		for(uint32_t i = 0; i < PointCloud::NumChannels; i++) {
+			samples[i].clear();
+		}
+	}
+
+	/*
+	 */
+	bool PointSampler::resampleGrid(Async &async, PointCloud &cloud, float32_t s) {
+
+		if(s <= 0.0f || cloud.getSize() == 0) {
+			TS_LOG(Error, "PointSampler::resampleGrid(): invalid parameters\n");
+			return false;
+		}
+		if(!async.isInitialized() && !async.init()) {
+			TS_LOG(Error, "PointSampler::resampleGrid(): can't initialize async\n");
+			return false;
+		}
+
+		// points sorted by their voxels
+		create_bounds(async, cloud);
+		if(!create_cells(async, cloud, nullptr, s)) {
+			TS_LOGF(Error, "PointSampler::resampleGrid(): spacing %f is too small for the point bounds\n", s);
+			return false;
+		}
+
+		// voxel centroids in the cell order
+		for(uint32_t i = 0; i < PointCloud::NumChannels; i++) {
+			samples[i].resize(cells.size());
+		}
+		Array<Async::Task> tasks;
+		for(uint32_t begin = 0; begin < cells.size(); begin += CellTaskSize) {
+			tasks.append(async.run(makeClassFunction(this, &PointSampler::update_centroids, &cloud, begin, min(begin + CellTaskSize, cells.size()))));
+		}
+		async.wait(tasks);
+
+		if(!store_points(cloud, cells.size())) return false;
+		spacing = s;
+
+		return true;
+	}
+
+	/*
+	 */
+	bool PointSampler::resamplePoisson(Async &async, PointCloud &cloud, uint32_t num_points) {
+
+		uint32_t size = cloud.getSize();
+		if(num_points == 0 || size == 0) {
+			TS_LOG(Error, "PointSampler::resamplePoisson(): invalid parameters\n");
+			return false;
+		}
+		if(!async.isInitialized() && !async.init()) {
+			TS_LOG(Error, "PointSampler::resamplePoisson(): can't initialize async\n");
+			return false;
+		}
+		create_bounds(async, cloud);
+
+		// random priority order of the points
+		keys.resize(size);
+		values.resize(size);
+		for(uint32_t i = 0; i < size; i++) {
+			keys[i] = get_priority(i);
+			values[i] = i;
+		}
+		sort_keys(Maxu32);
+		priorities.copy(values);
+
+		// disk radius search in the log-log space of the radius and the number of samples
+		// surface scans have an exponent near -2 and volumes near -3.
+		Vector3f extent = bound_max - bound_min;
+		float32_t max_extent = max(max(extent.x, extent.y), max(extent.z, 1e-6f));
+		float32_t min_radius = max_extent / (float32_t)MaxCells;
+		float32_t radius = max(max_extent * pow((float32_t)num_points, -0.4f), min_radius);
+		float32_t lower_radius = 0.0f, upper_radius = Maxf32;
+		float32_t best_radius = 0.0f, last_radius = 0.0f;
+		float32_t sampled_radius = 0.0f;		// radius of the current accepted samples
+		uint32_t best_count = Maxu32, last_count = 0;
+		float32_t exponent = -2.5f;
+		for(uint32_t i = 0; i < 24; i++) {
+			uint32_t count = sample_disks(async, cloud, radius);
+			sampled_radius = radius;
+			if(count >= num_points) {
+				if(count < best_count) {
+					best_count = count;
+					best_radius = radius;
+				}
+				lower_radius = max(lower_radius, radius);
+				if(count <= num_points + num_points / 50) break;
+			} else {
+				upper_radius = min(upper_radius, radius);
+				if(radius <= min_radius) break;
+			}
+			if(i && radius != last_radius && count != last_count) {
+				exponent = clamp(log((float32_t)count / (float32_t)last_count) / log(radius / last_radius), -4.0f, -1.0f);
+			}
+			last_radius = radius;
+			last_count = count;
+			radius = radius * pow((float32_t)num_points * 1.01f / (float32_t)max(count, 1u), 1.0f / exponent);
+			if(radius <= lower_radius || radius >= upper_radius) {
+				radius = (upper_radius < Maxf32) ? sqrt(max(lower_radius, min_radius) * upper_radius) : radius;
+			}
+			radius = max(radius, min_radius);
+		}
+
+		// coincident points can't reach the number of samples
+		if(best_count == Maxu32) {
+			best_radius = min_radius;
+			TS_LOGF(Warning, "PointSampler::resamplePoisson(): %u points are too close for %u samples\n", size, num_points);
+		}
+		if(sampled_radius != best_radius) {
+			best_count = sample_disks(async, cloud, best_radius);
+		}
+
+		// extra samples are dropped in the priority order
+		scratch.resize(size);
+		for(uint32_t i = 0; i < size; i++) {
+			scratch[values[i]] = i;
+		}
+		uint32_t num_samples = 0;
+		for(uint32_t i = 0; i < size; i++) {
+			uint32_t slot = scratch[priorities[i]];
+			if(!accepted[slot]) continue;
+			if(num_samples < num_points) num_samples++;
+			else accepted[slot] = 0;
+		}
+
+		// samples in the cell order
+		for(uint32_t i = 0; i < PointCloud::NumChannels; i++) {
+			samples[i].resize(num_samples);
+		}
+		for(uint32_t i = 0, j = 0; i < size; i++) {
+			if(!accepted[i]) continue;
+			Vector3f position = cloud.getPosition(values[i]);
+			samples[PointCloud::ChannelX][j] = position.x;
+			samples[PointCloud::ChannelY][j] = position.y;
+			samples[PointCloud::ChannelZ][j] = position.z;
+			j++;
+		}
+
+		if(!store_points(cloud, num_samples)) return false;
+		spacing = best_radius;
+
+		return true;
+	}
+
+	/*
+	 */
+	bool PointSampler::fillVolume(Async &async, PointCloud &cloud, float32_t s, uint32_t max_points) {
+
+		if(s <= 0.0f || cloud.getSize() == 0) {
+			TS_LOG(Error, "PointSampler::fillVolume(): invalid parameters\n");
+			return false;
+		}
+		if(!async.isInitialized() && !async.init()) {
+			TS_LOG(Error, "PointSampler::fillVolume(): can't initialize async\n");
+			return false;
+		}
+
+		// surface voxels with two free voxel layers around them
+		create_bounds(async, cloud);
+		bound_min -= s * 2.0f;
+		bound_max += s * 2.0f;
+		if(!create_cells(async, cloud, nullptr, s) || (uint64_t)grid_size.x * grid_size.y * grid_size.z > MaxVoxels) {
+			TS_LOGF(Error, "PointSampler::fillVolume(): spacing %f is too small for the point bounds\n", s);
+			return false;
+		}
+		voxels.resize(grid_size.x * grid_size.y * grid_size.z);
+		memset(voxels.get(), VoxelInside, voxels.bytes());
+		for(const Cell &cell : cells) {
+			voxels[cell.key] = VoxelSurface;
+		}
+
+		// surface holes are closed by the dilation of the surface voxels
+		uint32_t num_closing = 0;
+		for(const Cell &cell : cells) {
+			uint32_t x = cell.key % grid_size.x;
+			uint32_t y = (cell.key / grid_size.x) % grid_size.y;
+			uint32_t z = cell.key / (grid_size.x * grid_size.y);
+			for(uint32_t Z = max(z, 1u) - 1; Z <= min(z + 1, grid_size.z - 1); Z++) {
+				for(uint32_t Y = max(y, 1u) - 1; Y <= min(y + 1, grid_size.y - 1); Y++) {
+					for(uint32_t X = max(x, 1u) - 1; X <= min(x + 1, grid_size.x - 1); X++) {
+						uint8_t &voxel = voxels[(Z * grid_size.y + Y) * grid_size.x + X];
+						if(voxel != VoxelInside) continue;
+						voxel = VoxelClosing;
+						num_closing++;
+					}
+				}
+			}
+		}
+
+		// open surfaces leak the flood fill into the shell
+		uint32_t num_outside = fill_outside();
+		if(num_outside + num_closing + cells.size() == voxels.size()) {
+			TS_LOGF(Warning, "PointSampler::fillVolume(): surface is not closed at spacing %f\n", s);
+		}
+
+		// dilated voxels next to the outside are eroded back, the surface voxels are kept
+		for(const Cell &cell : cells) {
+			uint32_t x = cell.key % grid_size.x;
+			uint32_t y = (cell.key / grid_size.x) % grid_size.y;
+			uint32_t z = cell.key / (grid_size.x * grid_size.y);
+			for(uint32_t Z = max(z, 1u) - 1; Z <= min(z + 1, grid_size.z - 1); Z++) {
+				for(uint32_t Y = max(y, 1u) - 1; Y <= min(y + 1, grid_size.y - 1); Y++) {
+					for(uint32_t X = max(x, 1u) - 1; X <= min(x + 1, grid_size.x - 1); X++) {
+						uint8_t &voxel = voxels[(Z * grid_size.y + Y) * grid_size.x + X];
+						if(voxel != VoxelClosing) continue;
+						bool outside = false;
+						for(uint32_t k = max(Z, 1u) - 1; k <= min(Z + 1, grid_size.z - 1) && !outside; k++) {
+							for(uint32_t j = max(Y, 1u) - 1; j <= min(Y + 1, grid_size.y - 1) && !outside; j++) {
+								for(uint32_t i = max(X, 1u) - 1; i <= min(X + 1, grid_size.x - 1) && !outside; i++) {
+									outside = (voxels[(k * grid_size.y + j) * grid_size.x + i] == VoxelOutside);
+								}
+							}
+						}
+						if(outside) voxel = VoxelEroded;
+					}
+				}
+			}
+		}
+
+		// lattice points are counted before the allocation
+		slice_offsets.resize(grid_size.z + 1);
+		slice_offsets[0] = 0;
+		Array<Async::Task> tasks;
+		for(uint32_t begin = 0; begin < grid_size.z; begin += SliceTaskSize) {
+			tasks.append(async.run(makeClassFunction(this, &PointSampler::update_lattice_counts, begin, min(begin + SliceTaskSize, grid_size.z))));
+		}
+		async.wait(tasks);
+		for(uint32_t i = 0; i < grid_size.z; i++) {
+			slice_offsets[i + 1] += slice_offsets[i];
+		}
+		uint32_t num_points = slice_offsets[grid_size.z];
+		TS_LOGF(Message, "PointSampler::fillVolume(): %u lattice points of %u surface voxels\n", num_points, cells.size());
+		if(num_points > max_points) {
+			TS_LOGF(Error, "PointSampler::fillVolume(): %u lattice points exceed the budget of %u points\n", num_points, max_points);
+			return false;
+		}
+		if(num_points > PointCloud::MaxSize) {
+			TS_LOGF(Error, "PointSampler::fillVolume(): %u lattice points exceed the point cloud limit of %u points\n", num_points, (uint32_t)PointCloud::MaxSize);
+			return false;
+		}
+
+		// lattice points in the voxel order
+		for(uint32_t i = 0; i < PointCloud::NumChannels; i++) {
+			samples[i].resize(num_points);
+		}
+		tasks.clear();
+		for(uint32_t begin = 0; begin < grid_size.z; begin += SliceTaskSize) {
+			tasks.append(async.run(makeClassFunction(this, &PointSampler::update_lattice, begin, min(begin + SliceTaskSize, grid_size.z))));
+		}
+		async.wait(tasks);
+
+		if(!store_points(cloud, num_points)) return false;
+		spacing = s;
+
+		return true;
+	}
+
+	uint32_t PointSampler::fill_outside() {
+
+		// the corner voxel is in the free layers of the grid border
+		uint32_t stride_y = grid_size.x;
+		uint32_t stride_z = grid_size.x * grid_size.y;
+		scratch.clear();
+		scratch.append(0);
+		voxels[0] = VoxelOutside;
+		uint32_t ret = 1;
+		while(scratch.size()) {
+			uint32_t index = scratch.back();
+			scratch.removeBack();
+			uint32_t x = index % grid_size.x;
+			uint32_t y = (index / grid_size.x) % grid_size.y;
+			uint32_t z = index / stride_z;
+			uint32_t neighbors[6];
+			uint32_t num_neighbors = 0;
+			if(x > 0) neighbors[num_neighbors++] = index - 1;
+			if(x + 1 < grid_size.x) neighbors[num_neighbors++] = index + 1;
+			if(y > 0) neighbors[num_neighbors++] = index - stride_y;
+			if(y + 1 < grid_size.y) neighbors[num_neighbors++] = index + stride_y;
+			if(z > 0) neighbors[num_neighbors++] = index - stride_z;
+			if(z + 1 < grid_size.z) neighbors[num_neighbors++] = index + stride_z;
+			for(uint32_t i = 0; i < num_neighbors; i++) {
+				if(voxels[neighbors[i]] != VoxelInside) continue;
+				voxels[neighbors[i]] = VoxelOutside;
+				scratch.append(neighbors[i]);
+				ret++;
+			}
+		}
+		return ret;
+	}
+
+	void PointSampler::update_lattice_counts(uint32_t begin, uint32_t end) {
+		uint32_t slice_size = grid_size.x * grid_size.y;
+		for(uint32_t z = begin; z < end; z++) {
+			const uint8_t *slice = voxels.get() + slice_size * z;
+			uint32_t count = 0;
+			for(uint32_t i = 0; i < slice_size; i++) {
+				count += (slice[i] < VoxelOutside);
+			}
+			slice_offsets[z + 1] = count;
+		}
+	}
+
+	void PointSampler::update_lattice(uint32_t begin, uint32_t end) {
+		float32_t *TS_RESTRICT dest_x = samples[PointCloud::ChannelX].get();
+		float32_t *TS_RESTRICT dest_y = samples[PointCloud::ChannelY].get();
+		float32_t *TS_RESTRICT dest_z = samples[PointCloud::ChannelZ].get();
+		for(uint32_t z = begin; z < end; z++) {
+			const uint8_t *voxel = voxels.get() + grid_size.x * grid_size.y * z;
+			uint32_t offset = slice_offsets[z];
+			for(uint32_t y = 0; y < grid_size.y; y++) {
+				for(uint32_t x = 0; x < grid_size.x; x++, voxel++) {
+					if(*voxel >= VoxelOutside) continue;
+					dest_x[offset] = grid_origin.x + ((float32_t)x + 0.5f) * cell_size;
+					dest_y[offset] = grid_origin.y + ((float32_t)y + 0.5f) * cell_size;
+					dest_z[offset] = grid_origin.z + ((float32_t)z + 0.5f) * cell_size;
+					offset++;
+				}
+			}
+		}
+	}
+
+	/*
+	 */
+	void PointSampler::create_bounds(Async &async, const PointCloud &cloud) {
+		uint32_t size = cloud.getSize();
+		uint32_t num_tasks = (size + TaskSize - 1) / TaskSize;
+		task_bounds.resize(num_tasks * 2);
+		Array<Async::Task> tasks;
+		for(uint32_t begin = 0; begin < size; begin += TaskSize) {
+			tasks.append(async.run(makeClassFunction(this, &PointSampler::update_bounds, &cloud, begin, min(begin + TaskSize, size))));
+		}
+		async.wait(tasks);
+		bound_min = task_bounds[0];
+		bound_max = task_bounds[1];
+		for(uint32_t i = 1; i < num_tasks; i++) {
+			bound_min = min(bound_min, task_bounds[i * 2 + 0]);
+			bound_max = max(bound_max, task_bounds[i * 2 + 1]);
+		}
+	}
+
+	void PointSampler::update_bounds(const PointCloud *cloud, uint32_t begin, uint32_t end) {
+		Vector3f bmin = cloud->getPosition(begin);
+		Vector3f bmax = bmin;
+		for(uint32_t i = begin + 1; i < end; i++) {
+			Vector3f position = cloud->getPosition(i);
+			bmin = min(bmin, position);
+			bmax = max(bmax, position);
+		}
+		task_bounds[(begin / TaskSize) * 2 + 0] = bmin;
+		task_bounds[(begin / TaskSize) * 2 + 1] = bmax;
+	}
+
+	/*
+	 */
+	void PointSampler::sort_keys(uint32_t max_key) {
+
+		// stable LSD radix sort of the keys and values
+		uint32_t size = keys.size();
+		scratch.resize(size * 2);
+		uint32_t *TS_RESTRICT src_keys = keys.get();
+		uint32_t *TS_RESTRICT src_values = values.get();
+		uint32_t *TS_RESTRICT dest_keys = scratch.get();
+		uint32_t *TS_RESTRICT dest_values = scratch.get() + size;
+		for(uint32_t shift = 0; shift < 32 && (max_key >> shift); shift += 11) {
+			uint32_t counts[2048] = {};
+			for(uint32_t i = 0; i < size; i++) {
+				counts[(src_keys[i] >> shift) & 2047u]++;
+			}
+			uint32_t offset = 0;
+			for(uint32_t &count : counts) {
+				uint32_t num = count;
+				count = offset;
+				offset += num;
+			}
+			for(uint32_t i = 0; i < size; i++) {
+				uint32_t j = counts[(src_keys[i] >> shift) & 2047u]++;
+				dest_keys[j] = src_keys[i];
+				dest_values[j] = src_values[i];
+			}
+			swap(src_keys, dest_keys);
+			swap(src_values, dest_values);
+		}
+		if(src_keys != keys.get()) {
+			memcpy(keys.get(), src_keys, sizeof(uint32_t) * size);
+			memcpy(values.get(), src_values, sizeof(uint32_t) * size);
+		}
+	}
+
+	/*
+	 */
+	bool PointSampler::create_cells(Async &async, const PointCloud &cloud, const uint32_t *points, float32_t size) {
+
+		// linear cell indices must fit the keys
+		Vector3f extent = bound_max - bound_min;
+		uint64_t grid_x = (uint64_t)(extent.x / size) + 1;
+		uint64_t grid_y = (uint64_t)(extent.y / size) + 1;
+		uint64_t grid_z = (uint64_t)(extent.z / size) + 1;
+		if(grid_x * grid_y * grid_z >= Maxu32) return false;
+		grid_origin = bound_min;
+		grid_size = Vector3u((uint32_t)grid_x, (uint32_t)grid_y, (uint32_t)grid_z);
+		cell_size = size;
+		cell_scale = 1.0f / size;
+
+		// points sorted by their cells, the order of the points is kept inside the cells
+		uint32_t num_points = cloud.getSize();
+		keys.resize(num_points);
+		values.resize(num_points);
+		Array<Async::Task> tasks;
+		for(uint32_t begin = 0; begin < num_points; begin += TaskSize) {
+			tasks.append(async.run(makeClassFunction(this, &PointSampler::update_keys, &cloud, points, begin, min(begin + TaskSize, num_points))));
+		}
+		async.wait(tasks);
+		sort_keys(grid_size.x * grid_size.y * grid_size.z - 1);
+
+		// occupied cells
+		cells.clear();
+		for(uint32_t i = 0; i < num_points; i++) {
+			if(i == 0 || keys[i] != keys[i - 1]) cells.append({ keys[i], i, i, 0 });
+			cells.back().end = i + 1;
+		}
+
+		// open addressing table of the cells, the keys are stored in the table because most of the lookups are empty neighbors
+		uint32_t table_size = 1;
+		while(table_size < cells.size() * 4) table_size <<= 1;
+		table_mask = table_size - 1;
+		cell_table.resize(table_size);
+		for(Vector2u &slot : cell_table) slot = Vector2u(Maxu32);
+		for(uint32_t i = 0; i < cells.size(); i++) {
+			uint32_t slot = get_table_hash(cells[i].key) & table_mask;
+			while(cell_table[slot].x != Maxu32) slot = (slot + 1) & table_mask;
+			cell_table[slot] = Vector2u(cells[i].key, i);
+		}
+
+		return true;
+	}
+
+	const PointSampler::Cell *PointSampler::find_cell(uint32_t key) const {
+		uint32_t slot = get_table_hash(key) & table_mask;
+		while(cell_table[slot].x != Maxu32) {
+			if(cell_table[slot].x == key) return &cells[cell_table[slot].y];
+			slot = (slot + 1) & table_mask;
+		}
+		return nullptr;
+	}
+
+	void PointSampler::update_keys(const PointCloud *cloud, const uint32_t *points, uint32_t begin, uint32_t end) {
+		Vector3u max_index = grid_size - Vector3u(1u);
+		for(uint32_t i = begin; i < end; i++) {
+			uint32_t point = (points) ? points[i] : i;
+			Vector3f position = (cloud->getPosition(point) - grid_origin) * cell_scale;
+			Vector3u index = min(Vector3u(max(position, Vector3f(0.0f))), max_index);
+			keys[i] = (index.z * grid_size.y + index.y) * grid_size.x + index.x;
+			values[i] = point;
+		}
+	}
+
+	/*
+	 */
+	void PointSampler::update_centroids(const PointCloud *cloud, uint32_t begin, uint32_t end) {
+		for(uint32_t i = begin; i < end; i++) {
+			const Cell &cell = cells[i];
+			float64_t x = 0.0, y = 0.0, z = 0.0;
+			for(uint32_t j = cell.begin; j < cell.end; j++) {
+				Vector3f position = cloud->getPosition(values[j]);
+				x += position.x;
+				y += position.y;
+				z += position.z;
+			}
+			float64_t inumber = 1.0 / (float64_t)(cell.end - cell.begin);
+			samples[PointCloud::ChannelX][i] = (float32_t)(x * inumber);
+			samples[PointCloud::ChannelY][i] = (float32_t)(y * inumber);
+			samples[PointCloud::ChannelZ][i] = (float32_t)(z * inumber);
+		}
+	}
+
+	/*
+	 */
+	uint32_t PointSampler::sample_disks(Async &async, const PointCloud &cloud, float32_t radius) {
+
+		// cells of the disk radius with the points in the priority order
+		if(!create_cells(async, cloud, priorities.get(), radius)) return cloud.getSize();
+		disk_radius = radius;
+		accepted.resize(cloud.getSize());
+		memset(accepted.get(), 0, accepted.bytes());
+		disks.resize(cloud.getSize());
+
+		// cells of one phase are three cells apart and never see each other
+		memset(phase_offsets, 0, sizeof(phase_offsets));
+		for(const Cell &cell : cells) {
+			phase_offsets[get_phase(cell.key) + 1]++;
+		}
+		for(uint32_t i = 1; i < 28; i++) {
+			phase_offsets[i] += phase_offsets[i - 1];
+		}
+		uint32_t offsets[27];
+		memcpy(offsets, phase_offsets, sizeof(offsets));
+		phase_cells.resize(cells.size());
+		for(uint32_t i = 0; i < cells.size(); i++) {
+			phase_cells[offsets[get_phase(cells[i].key)]++] = i;
+		}
+
+		// greedy dart throwing of the phases
+		for(uint32_t phase = 0; phase < 27; phase++) {
+			Array<Async::Task> tasks;
+			for(uint32_t begin = phase_offsets[phase]; begin < phase_offsets[phase + 1]; begin += CellTaskSize) {
+				tasks.append(async.run(makeClassFunction(this, &PointSampler::update_disks, &cloud, begin, min(begin + CellTaskSize, phase_offsets[phase + 1]))));
+			}
+			async.wait(tasks);
+		}
+
+		uint32_t ret = 0;
+		for(uint8_t flag : accepted) ret += flag;
+		return ret;
+	}
+
+	uint32_t PointSampler::get_phase(uint32_t key) const {
+		uint32_t x = key % grid_size.x;
+		uint32_t y = (key / grid_size.x) % grid_size.y;
+		uint32_t z = key / (grid_size.x * grid_size.y);
+		return (z % 3) * 9 + (y % 3) * 3 + (x % 3);
+	}
+
+	void PointSampler::update_disks(const PointCloud *cloud, uint32_t begin, uint32_t end) {
+		float32_t radius2 = disk_radius * disk_radius;
+		for(uint32_t i = begin; i < end; i++) {
+			Cell &cell = cells[phase_cells[i]];
+			uint32_t x = cell.key % grid_size.x;
+			uint32_t y = (cell.key / grid_size.x) % grid_size.y;
+			uint32_t z = cell.key / (grid_size.x * grid_size.y);
+
+			// occupied neighbor cells
+			const Cell *neighbors[27];
+			uint32_t num_neighbors = 0;
+			for(uint32_t Z = max(z, 1u) - 1; Z <= min(z + 1, grid_size.z - 1); Z++) {
+				for(uint32_t Y = max(y, 1u) - 1; Y <= min(y + 1, grid_size.y - 1); Y++) {
+					for(uint32_t X = max(x, 1u) - 1; X <= min(x + 1, grid_size.x - 1); X++) {
+						const Cell *neighbor = find_cell((Z * grid_size.y + Y) * grid_size.x + X);
+						if(neighbor) neighbors[num_neighbors++] = neighbor;
+					}
+				}
+			}
+
+			// points are accepted in the priority order
+			for(uint32_t j = cell.begin; j < cell.end; j++) {
+				Vector3f position = cloud->getPosition(values[j]);
+				bool covered = false;
+				for(uint32_t k = 0; k < num_neighbors && !covered; k++) {
+					const Vector3f *neighbor_disks = disks.get() + neighbors[k]->begin;
+					for(uint32_t l = 0; l < neighbors[k]->num_disks; l++) {
+						if(length2(neighbor_disks[l] - position) < radius2) {
+							covered = true;
+							break;
+						}
+					}
+				}
+				if(covered) continue;
+				disks[cell.begin + cell.num_disks++] = position;
+				accepted[j] = 1;
+			}
+		}
+	}
+
+	/*
+	 */
+	bool PointSampler::store_points(PointCloud &cloud, uint32_t size) {
+		if(!cloud.resize(size)) return false;
+		for(uint32_t i = 0; i < PointCloud::NumChannels; i++) {
+			memcpy(cloud.get((PointCloud::Channel)i), samples[i].get(), sizeof(float32_t) * size);
+		}
+		return true;
+	}
+}
@@ -0,0 +1,144 @@
+#ifndef __MPM_POINT_SAMPLER_H__
+#define __MPM_POINT_SAMPLER_H__
+
+#include <core/TellusimArray.h>
+#include <core/TellusimAsync.h>
+#include <math/TellusimMath.h>
+
+#include "PointCloud.h"
+
+/*
+ */
+namespace Mpm {
+
+	using namespace Tellusim;
+
+	/**
+	 * PointSampler class
+	 * Multithreaded resampling of non-uniform point clouds over a hashed grid of sorted cells
+	 */
+	class PointSampler {
+
+		public:
+
+			PointSampler();
+			~PointSampler();
+
+			/// clear sampler
+			void clear();
+
+			/// replace the points of every occupied voxel by their centroid
+			/// \param spacing Voxel size.
+			bool resampleGrid(Async &async, PointCloud &cloud, float32_t spacing);
+
+			/// Poisson-disk subset of the points
+			/// the disk radius is searched until the maximal set has at least the requested points,
+			/// extra samples are dropped in the random priority order.
+			/// \param num_points Number of the output points.
+			bool resamplePoisson(Async &async, PointCloud &cloud, uint32_t num_points);
+
+			/// fill the closed surface of the points with a lattice of the spacing
+			/// surface voxels are closed by one voxel and the outside is flood filled from the grid border,
+			/// the lattice points of the remaining voxels are counted and logged before the allocation.
+			/// \param spacing Lattice spacing.
+			/// \param max_points Maximum number of the lattice points, larger solids fail before the allocation.
+			bool fillVolume(Async &async, PointCloud &cloud, float32_t spacing, uint32_t max_points = Maxu32);
+
+			/// point spacing of the last resampling
+			TS_INLINE float32_t getSpacing() const { return spacing; }
+
+		private:
+
+			PointSampler(const PointSampler&) = delete;
+			PointSampler &operator=(const PointSampler&) = delete;
+
+			/// Voxel states of the volume fill
+			enum {
+				VoxelInside = 0,			// not reached by the outside flood fill
+				VoxelSurface,
+				VoxelClosing,				// dilated surface
+				VoxelOutside,
+				VoxelEroded,				// dilated surface next to the outside
+			};
+
+			/// Occupied cell of the sorted points
+			struct Cell {
+				uint32_t key;					// linear cell index
+				uint32_t begin;
+				uint32_t end;
+				uint32_t num_disks;				// accepted disks of the Poisson-disk sampling
+			};
+
+			/// bounds of the points
+			void create_bounds(Async &async, const PointCloud &cloud);
+
+			/// stable radix sort of the keys and values
+			/// \param max_key Maximal key, the passes of the zero digits are skipped.
+			void sort_keys(uint32_t max_key);
+
+			/// sort the points by their cells and build the hashed cells
+			/// \param points Point indices in the sorting order, the identity when it is null.
+			bool create_cells(Async &async, const PointCloud &cloud, const uint32_t *points, float32_t size);
+
+			/// cell of the linear cell index
+			const Cell *find_cell(uint32_t key) const;
+
+			/// phase of the linear cell index, cells of one phase are three cells apart
+			uint32_t get_phase(uint32_t key) const;
+
+			/// sampling passes
+			void update_bounds(const PointCloud *cloud, uint32_t begin, uint32_t end);
+			void update_keys(const PointCloud *cloud, const uint32_t *points, uint32_t begin, uint32_t end);
+			void update_centroids(const PointCloud *cloud, uint32_t begin, uint32_t end);
+			void update_disks(const PointCloud *cloud, uint32_t begin, uint32_t end);
+
+			/// maximal Poisson-disk set of the radius
+			uint32_t sample_disks(Async &async, const PointCloud &cloud, float32_t radius);
+
+			/// flood fill of the outside voxels from the grid border, returns the number of the outside voxels
+			uint32_t fill_outside();
+
+			/// lattice points of the z slices of the voxels
+			void update_lattice_counts(uint32_t begin, uint32_t end);
+			void update_lattice(uint32_t begin, uint32_t end);
+
+			/// write the sampled points back into the cloud
+			bool store_points(PointCloud &cloud, uint32_t size);
+
+			float32_t spacing = 0.0f;
+
+			// grid of the cells
+			Vector3f bound_min = Vector3f(0.0f);
+			Vector3f bound_max = Vector3f(0.0f);
+			Array<Vector3f> task_bounds;
+			Vector3f grid_origin = Vector3f(0.0f);
+			Vector3u grid_size = Vector3u(0u);
+			float32_t cell_size = 0.0f;
+			float32_t cell_scale = 0.0f;
+
+			// points sorted by their cells
+			Array<uint32_t> keys;
+			Array<uint32_t> values;
+			Array<uint32_t> scratch;
+			Array<Cell> cells;
+			Array<Vector2u> cell_table;			// open addressing table of the cell keys and indices
+			uint32_t table_mask = 0;
+
+			// Poisson-disk sampling
+			Array<uint32_t> priorities;			// random order of the points
+			Array<uint32_t> phase_cells;		// cell indices of the 27 phases
+			uint32_t phase_offsets[28] = {};
+			Array<uint8_t> accepted;
+			Array<Vector3f> disks;				// accepted disk centers at the beginning of their cells
+			float32_t disk_radius = 0.0f;
+
+			// volume fill
+			Array<uint8_t> voxels;
+			Array<uint32_t> slice_offsets;		// first lattice point of every z slice
+
+			// sampled points
+			Array<float32_t> samples[PointCloud::NumChannels];
+	};
+}
+
+#endif /* __MPM_POINT_SAMPLER_H__ */
@@ -0,0 +1,141 @@
+#include "Scene.h"
+#include "Kernels.h"
+
+#include <core/TellusimLog.h>
+#include <core/TellusimFile.h>
+
+/*
+ */
+namespace Mpm {
+
+	/*
+	 */
+	static bool read_file(const char *name, String &dest) {
+		File file;
+		if(!file.open(name, "rb")) {
+			TS_LOGF(Error, "Scene::load(): can't open \"%s\" file\n", name);
+			return false;
+		}
+		dest = String((uint32_t)file.getSize());
+		if(file.read(dest.get(), dest.size()) != dest.size()) {
+			TS_LOGF(Error, "Scene::load(): can't read \"%s\" file\n", name);
+			return false;
+		}
+		return true;
+	}
+
+	static TS_INLINE bool is_separator(char c) {
+		return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+	}
+
+	/// next assignment token, comments are skipped
+	static bool get_token(const char *&str, const char *&begin, const char *&end) {
+		while(*str) {
+			if(*str == '#') {
+				while(*str && *str != '\n') str++;
+			} else if(is_separator(*str)) {
+				str++;
+			} else {
+				begin = str;
+				while(*str && *str != '#' && !is_separator(*str)) str++;
+				end = str;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/*
+	 */
+	Scene::Scene() {
+
+	}
+
+	Scene::~Scene() {
+
+	}
+
+	/*
+	 */
+	void Scene::clear() {
+		input.clear();
+		physics = PhysicsParameters();
+	}
+
+	/*
+	 */
+	bool Scene::load(const char *name) {
+		String data;
+		if(!read_file(name, data)) return false;
+		if(!parse(data.get())) {
+			TS_LOGF(Error, "Scene::load(): can't parse \"%s\" file\n", name);
+			return false;
+		}
+		return true;
+	}
+
+	bool Scene::parse(const char *str) {
+		const char *begin = nullptr;
+		const char *end = nullptr;
+		while(get_token(str, begin, end)) {
+			const char *value = begin;
+			while(value < end && *value != '=') value++;
+			if(value == end || value == begin) {
+				TS_LOGF(Error, "Scene::parse(): invalid assignment \"%s\"\n", String(begin, (uint32_t)(end - begin)).get());
+				return false;
+			}
+			if(!set(String(begin, (uint32_t)(value - begin)), String(value + 1, (uint32_t)(end - value - 1)))) return false;
+		}
+		return true;
+	}
+
+	bool Scene::set(const String &key, const String &value) {
+		if(key == "input") input = value;
+		else if(key == "stiffness") physics.stiffness = value.tof32();
+		else if(key == "rest_density") physics.rest_density = value.tof32();
+		else if(key == "density_length") physics.density_length = value.tof32();
+		else if(key == "viscosity") physics.viscosity = value.tof32();
+		else if(key == "smoothing_length") physics.smoothing_length = value.tof32();
+		else if(key == "box_size") physics.box_size = value.tof32();
+		else if(key == "gravity") physics.gravity = value.tof32();
+		else if(key == "kernel") {
+			if(value == "cubic") physics.kernel = KernelCubic;
+			else if(value == "wendland") physics.kernel = KernelWendland;
+			else {
+				TS_LOGF(Error, "Scene::set(): unknown kernel \"%s\"\n", value.get());
+				return false;
+			}
+		}
+		else {
+			TS_LOGF(Error, "Scene::set(): unknown parameter \"%s\"\n", key.get());
+			return false;
+		}
+		return true;
+	}
+
+	/*
+	 */
+	bool Scene::loadSweep(const char *name, Array<PhysicsParameters> &sets) const {
+		String data;
+		if(!read_file(name, data)) return false;
+
+		// lines without assignments are skipped
+		sets.clear();
+		for(uint32_t begin = 0, end = 0; begin < data.size(); begin = end + 1) {
+			for(end = begin; end < data.size() && data[end] != '\n'; end++);
+			String line = data.substring(begin, end - begin);
+			const char *str = line.get();
+			const char *token_begin = nullptr;
+			const char *token_end = nullptr;
+			if(!get_token(str, token_begin, token_end)) continue;
+			Scene scene = *this;
+			if(!scene.parse(line.get())) {
+				TS_LOGF(Error, "Scene::loadSweep(): can't parse \"%s\" file\n", name);
+				return false;
+			}
+			sets.append(scene.physics);
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef __MPM_SCENE_H__
+#define __MPM_SCENE_H__
+
+#include <core/TellusimArray.h>
+#include <core/TellusimString.h>
+
+#include "Parameters.h"
+
+/*
+ */
+namespace Mpm {
+
+	/**
+	 * Scene class
+	 * Simulation input and physical parameters of "key=value" text files
+	 * Assignments are separated by spaces or new lines, "#" comments out the rest of the line
+	 */
+	class Scene {
+
+		public:
+
+			Scene();
+			~Scene();
+
+			/// clear scene
+			void clear();
+
+			/// load scene file
+			bool load(const char *name);
+
+			/// apply assignments over the current parameters
+			bool parse(const char *str);
+
+			/// load parameter sweep
+			/// every line of the file is one parameter set applied over the scene parameters.
+			bool loadSweep(const char *name, Array<PhysicsParameters> &sets) const;
+
+			/// scene parameters
+			TS_INLINE void setInput(const char *name) { input = name; }
+			TS_INLINE const String &getInput() const { return input; }
+			TS_INLINE void setPhysics(const PhysicsParameters &parameters) { physics = parameters; }
+			TS_INLINE const PhysicsParameters &getPhysics() const { return physics; }
+
+		private:
+
+			/// single assignment
+			bool set(const String &key, const String &value);
+
+			String input;						// LAS file name
+			PhysicsParameters physics;
+	};
+}
+
+#endif /* __MPM_SCENE_H__ */
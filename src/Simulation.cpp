@@ -0,0 +1,820 @@
+#include "Simulation.h"
+
+#include <core/TellusimLog.h>
+#include <platform/TellusimShader.h>
+#include <platform/TellusimCompute.h>
+
+/*
+ */
+#define PARTICLE_MASS	0.7f
+
+/*
+ */
+namespace Mpm {
+
+	/*
+	 */
+	Simulation::Simulation() {
+
+	}
+
+	Simulation::~Simulation() {
+
+	}
+
+	/*
+	 */
+	void Simulation::clear() {
+		backend = BackendGPU;
+		created = false;
+		num_particles = 0;
+		particles.clear();
+		scene_offsets.clear();
+		scene_ids.clear();
+		scene_parameters.clear();
+		scene_spacings.clear();
+		solver_parameters.clear();
+		interaction_forces.clear();
+		device = Device();
+		kernel = Kernel();
+		pressure_density = Kernel();
+		reorder_keys = Kernel();
+		reorder_permute = Kernel();
+		for(uint32_t i = 0; i < 2; i++) {
+			position_buffers[i] = Buffer();
+			velocity_buffers[i] = Buffer();
+			order_buffers[i] = Buffer();
+		}
+		density_buffer = Buffer();
+		pressure_buffer = Buffer();
+		mass_buffer = Buffer();
+		interaction_buffer = Buffer();
+		scene_buffer = Buffer();
+		spatial_buffer = Buffer();
+		reorder_buffer = Buffer();
+		scalar_buffer = Buffer();
+		radix_sort.clear();
+		prefix_scan.clear();
+		spatial_grid.clear();
+		grid_bits = 0;
+		step_index = 0;
+		reorder_step = 0;
+		reorder_bits = 0;
+		cpu_solver.clear();
+		mpm_solver.clear();
+	}
+
+	/*
+	 */
+	bool Simulation::load(const char *name, const Matrix4x4f &transform) {
+		Scene scene;
+		scene.setInput(name);
+		scene.setPhysics(physics);
+		return load(Array<Scene>(1, scene), transform);
+	}
+
+	bool Simulation::load(const Array<Scene> &scenes, const Matrix4x4f &transform) {
+
+		// particles of every scene are contiguous in the loaded order
+		// ensemble points are gathered with the geometric growth and copied into the particles once
+		// loader threads are released after the load
+		Async async;
+		PointCloud cloud;
+		PointCloud points;
+		PointSampler sampler;
+		scene_offsets.clear();
+		scene_spacings.clear();
+		num_particles = 0;
+		for(const Scene &scene : scenes) {
+			const char *name = scene.getInput().get();
+			String cache_name = String::format("%s.points", name);
+			uint64_t source_hash = (point_cache) ? PointCloud::getSourceHash(name) : 0;
+			if(!point_cache || !cloud.loadCache(cache_name.get(), source_hash, transform)) {
+				if(!cloud.load(async, name, transform)) return false;
+				if(point_cache && cloud.saveCache(cache_name.get(), source_hash, transform)) {
+					TS_LOGF(Message, "Simulation::load(): \"%s\" point cache is created\n", cache_name.get());
+				}
+			}
+
+			// resampled scenes keep the particle mass, the solvers scale their parameters to the spacing
+			float32_t spacing = 0.0f;
+			if(sampling != SamplingNone) {
+				uint32_t num_points = cloud.getSize();
+				if(sampling == SamplingGrid && !sampler.resampleGrid(async, cloud, (sampling_spacing > 0.0f) ? sampling_spacing : radius * 2.0f)) return false;
+				if(sampling == SamplingPoisson && !sampler.resamplePoisson(async, cloud, sampling_points)) return false;
+				if(sampling == SamplingVolume && !sampler.fillVolume(async, cloud, (sampling_spacing > 0.0f) ? sampling_spacing : radius * 2.0f, (sampling_points) ? sampling_points : Maxu32)) return false;
+				spacing = sampler.getSpacing();
+				TS_LOGF(Message, "Simulation::load(): \"%s\" %u points are resampled to %u particles of %g spacing and %g rest density\n", name, num_points, cloud.getSize(), spacing, PARTICLE_MASS / (spacing * spacing * spacing));
+			}
+			scene_spacings.append(spacing);
+			if(scenes.size() > 1) {
+				if(!points.resize(num_particles + cloud.getSize())) return false;
+				for(uint32_t i = 0; i < PointCloud::NumChannels; i++) {
+					memcpy(points.get((PointCloud::Channel)i) + num_particles, cloud.get((PointCloud::Channel)i), sizeof(float32_t) * cloud.getSize());
+				}
+			}
+			scene_offsets.append(num_particles);
+			num_particles += cloud.getSize();
+		}
+		scene_offsets.append(num_particles);
+		if(num_particles == 0) {
+			TS_LOG(Error, "Simulation::load(): no scenes\n");
+			return false;
+		}
+
+		// a single scene is copied from its cloud, the mapped cache is not uploaded directly:
+		// reset() restarts from the loaded particles, the CPU solvers copy them into their own
+		// stores and the GPU upload interleaves the channels into vectors, and the mapping of
+		// a resampled or ensemble cloud is replaced by the heap anyway
+		const PointCloud &source = (scenes.size() > 1) ? points : cloud;
+		if(!particles.create(num_particles)) return false;
+		for(uint32_t i = 0; i < PointCloud::NumChannels; i++) {
+			memcpy(particles.get((ParticleStore::Channel)(ParticleStore::ChannelX + i)), source.get((PointCloud::Channel)i), sizeof(float32_t) * num_particles);
+		}
+
+		// a single scene sets the simulation parameters, ensemble scenes keep their physical parameters
+		scene_ids.clear();
+		scene_parameters.clear();
+		if(scenes.size() == 1) physics = scenes[0].getPhysics();
+		else {
+			scene_ids.resize(num_particles);
+			scene_parameters.resize(scenes.size());
+			for(uint32_t i = 0; i < scenes.size(); i++) {
+				for(uint32_t j = scene_offsets[i]; j < scene_offsets[i + 1]; j++) scene_ids[j] = i;
+				scene_parameters[i] = scenes[i].getPhysics();
+			}
+		}
+
+		update_scene_parameters();
+
+		// particle masses and interaction
+		particles.fill(ParticleStore::ChannelMass, PARTICLE_MASS);
+		interaction_forces.resize(1);
+		interaction_forces[0] = Vector4f(0.0f);
+
+		return true;
+	}
+
+	/*
+	 */
+	void Simulation::setSampling(Sampling mode, float32_t spacing, uint32_t num_points) {
+		sampling = mode;
+		sampling_spacing = spacing;
+		sampling_points = num_points;
+	}
+
+	/*
+	 */
+	bool Simulation::create(const Device &d) {
+
+		backend = BackendGPU;
+		device = d;
+
+		// check particles
+		if(num_particles == 0) {
+			TS_LOG(Error, "Simulation::create(): particles are not loaded\n");
+			return false;
+		}
+
+		update_grid_bounds();
+
+		// check compute shader support
+		if(!device.hasShader(Shader::TypeCompute)) {
+			TS_LOG(Error, "Simulation::create(): compute shader is not supported\n");
+			return false;
+		}
+		if(solver != SolverSPH) {
+			TS_LOG(Error, "Simulation::create(): MPM solver is CPU only\n");
+			return false;
+		}
+		if(pressure_solver != CPUSolver::PressureEOS) {
+			TS_LOG(Error, "Simulation::create(): incompressible pressure solvers are CPU only\n");
+			return false;
+		}
+		if(deterministic) {
+			TS_LOG(Warning, "Simulation::create(): GPU results are not reproducible, only the time step is fixed\n");
+		}
+		if(adaptive) {
+			TS_LOG(Warning, "Simulation::create(): adaptive time step is CPU only, the time step is fixed\n");
+		}
+		if(num_levels > 1) {
+			TS_LOG(Warning, "Simulation::create(): time levels are CPU only, all particles use the time step\n");
+		}
+		created = true;
+		for(uint32_t i = 0; i < getNumScenes(); i++) check_kernel(i);
+
+		// ensemble scenes read their physical parameters from the scene buffer
+		uint32_t num_scenes = getNumScenes();
+		uint32_t ensemble = (num_scenes > 1) ? 1 : 0;
+
+		// create kernel
+		kernel = device.createKernel().setUniforms(1).setStorages(9 + ensemble, false);
+		if(!kernel.loadShaderGLSL("../src/main.comp", "COMPUTE_SHADER=1; ENSEMBLE_SHADER=%u; GROUP_SIZE=%uu", ensemble, group_size)) return false;
+		if(!kernel.create()) return false;
+
+		// create pressure/density kernel
+		pressure_density = device.createKernel().setUniforms(1).setStorages(6 + ensemble, false);
+		if(!pressure_density.loadShaderGLSL("../src/pressureDensity.comp", "COMPUTE_SHADER=1; ENSEMBLE_SHADER=%u; GROUP_SIZE=%uu", ensemble, group_size)) return false;
+		if(!pressure_density.create()) return false;
+
+		// create reorder kernels
+		reorder_keys = device.createKernel().setUniforms(1).setStorages(2, false);
+		if(!reorder_keys.loadShaderGLSL("../src/reorder.comp", "COMPUTE_SHADER=1; KEYS_SHADER=1; GROUP_SIZE=%uu", group_size)) return false;
+		if(!reorder_keys.create()) return false;
+		reorder_permute = device.createKernel().setUniforms(1).setStorages(12, false);
+		if(!reorder_permute.loadShaderGLSL("../src/reorder.comp", "COMPUTE_SHADER=1; PERMUTE_SHADER=1; GROUP_SIZE=%uu", group_size)) return false;
+		if(!reorder_permute.create()) return false;
+
+		// create buffers
+		size_t vector_bytes = sizeof(Vector4f) * num_particles;
+		size_t scalar_bytes = sizeof(float32_t) * num_particles;
+		position_buffers[0] = device.createBuffer(Buffer::FlagVertex | Buffer::FlagStorage, vector_bytes);
+		position_buffers[1] = device.createBuffer(Buffer::FlagVertex | Buffer::FlagStorage, vector_bytes);
+		velocity_buffers[0] = device.createBuffer(Buffer::FlagStorage, vector_bytes);
+		velocity_buffers[1] = device.createBuffer(Buffer::FlagStorage, vector_bytes);
+		density_buffer = device.createBuffer(Buffer::FlagStorage, scalar_bytes);
+		pressure_buffer = device.createBuffer(Buffer::FlagStorage, scalar_bytes);
+		mass_buffer = device.createBuffer(Buffer::FlagStorage, scalar_bytes);
+		interaction_buffer = device.createBuffer(Buffer::FlagStorage, interaction_forces.get(), interaction_forces.bytes());
+		order_buffers[0] = device.createBuffer(Buffer::FlagStorage, sizeof(uint32_t) * num_particles);
+		order_buffers[1] = device.createBuffer(Buffer::FlagStorage, sizeof(uint32_t) * num_particles);
+		if(!position_buffers[0] || !position_buffers[1]) return false;
+		if(!velocity_buffers[0] || !velocity_buffers[1]) return false;
+		if(!density_buffer || !pressure_buffer) return false;
+		if(!mass_buffer || !interaction_buffer) return false;
+		if(!order_buffers[0] || !order_buffers[1]) return false;
+		if(!upload_particles()) return false;
+		if(!device.setBuffer(mass_buffer, particles.get(ParticleStore::ChannelMass))) return false;
+		if(ensemble) {
+			scene_buffer = device.createBuffer(Buffer::FlagStorage, solver_parameters.get(), solver_parameters.bytes());
+			if(!scene_buffer) return false;
+		}
+
+		// create spatial grid
+		if(!radix_sort.create(device, RadixSort::ModeSingle, prefix_scan, num_particles, group_size)) return false;
+		if(!spatial_grid.create(device, radix_sort, group_size)) return false;
+
+		// sort only the bits of the bounded grid hashes
+		// scenes are stacked in consecutive blocks of cells, so one sort isolates all scenes
+		Vector3u grid_size = getGridSize();
+		uint32_t num_cells = grid_size.x * grid_size.y * grid_size.z * num_scenes;
+		for(grid_bits = 1; grid_bits < 32 && (1u << grid_bits) < num_cells; grid_bits++);
+
+		// create spatial buffer, the ranges begin after the aligned hashes
+		uint32_t hashes_size = TS_ALIGN4(num_particles) * 2;
+		uint32_t ranges_size = num_cells * 2;
+		spatial_buffer = device.createBuffer(Buffer::FlagStorage, sizeof(uint32_t) * (hashes_size + ranges_size));
+		if(!spatial_buffer || !device.clearBuffer(spatial_buffer)) return false;
+
+		// Morton keys and values of the reordering, and the permuted mass, density and pressure blocks
+		uint32_t axis_bits = 1;
+		while(axis_bits < 10 && (1u << axis_bits) < max(max(grid_size.x, grid_size.y), grid_size.z)) axis_bits++;
+		reorder_bits = axis_bits * 3;
+		reorder_buffer = device.createBuffer(Buffer::FlagStorage, sizeof(uint32_t) * TS_ALIGN4(num_particles) * 2);
+		scalar_buffer = device.createBuffer(Buffer::FlagStorage, sizeof(float32_t) * TS_ALIGN4(num_particles) * 3);
+		if(!reorder_buffer || !scalar_buffer) return false;
+
+		return true;
+	}
+
+	bool Simulation::create(Async &async) {
+
+		backend = BackendCPU;
+		created = true;
+		for(uint32_t i = 0; i < getNumScenes(); i++) check_kernel(i);
+
+		// check particles
+		if(num_particles == 0) {
+			TS_LOG(Error, "Simulation::create(): particles are not loaded\n");
+			return false;
+		}
+
+		update_grid_bounds();
+
+		// create mpm solver
+		if(solver == SolverMPM && getNumScenes() > 1) {
+			TS_LOG(Error, "Simulation::create(): MPM solver has no ensemble mode\n");
+			return false;
+		}
+		if(pressure_solver != CPUSolver::PressureEOS && getNumScenes() > 1) {
+			TS_LOG(Error, "Simulation::create(): incompressible pressure solvers have no ensemble mode\n");
+			return false;
+		}
+		if(solver == SolverMPM) {
+			if(!mpm_solver.create(async, num_particles, grid_min, grid_max, mpm_spacing)) return false;
+			mpm_solver.setParticles(particles);
+			return true;
+		}
+
+		// create cpu solver
+		if(!cpu_solver.create(async, num_particles, getGridSize(), getNumScenes())) return false;
+		cpu_solver.setSkin(skin);
+		cpu_solver.setReorderInterval(reorder_interval);
+		cpu_solver.setDeterministic(deterministic);
+		CPUSolver::PressureParameters parameters = pressure_parameters;
+		parameters.support = search_radius;
+		cpu_solver.setPressureSolver(pressure_solver, parameters);
+		cpu_solver.setTimeLevels(num_levels, level_cfl);
+		if(num_levels > 1 && pressure_solver != CPUSolver::PressureEOS) {
+			TS_LOG(Warning, "Simulation::create(): time levels are ignored by the incompressible pressure solvers\n");
+		}
+		cpu_solver.setParticles(particles, scene_ids.get());
+		cpu_solver.setSceneParameters(solver_parameters.get());
+
+		return true;
+	}
+
+	/*
+	 */
+	bool Simulation::reset() {
+		step_index = 0;
+		num_substeps = 0;
+		total_substeps = 0;
+		if(backend == BackendCPU && solver == SolverMPM) {
+			mpm_solver.setParticles(particles);
+			return true;
+		}
+		if(backend == BackendCPU) {
+			cpu_solver.setParticles(particles, scene_ids.get());
+			cpu_solver.resetStats();
+			return true;
+		}
+
+		// the first step starts from an empty grid as after create
+		if(spatial_buffer && !device.clearBuffer(spatial_buffer)) return false;
+		return upload_particles();
+	}
+
+	bool Simulation::upload_particles() {
+		Array<Vector4f> positions(num_particles);
+		Array<Vector4f> velocities(num_particles);
+		particles.getPositions(positions.get());
+		particles.getVelocities(velocities.get());
+		for(uint32_t i = 0; i < scene_ids.size(); i++) positions[i].w = (float32_t)scene_ids[i];
+		if(!device.setBuffer(position_buffers[0], positions.get())) return false;
+		if(!device.setBuffer(velocity_buffers[0], velocities.get())) return false;
+		if(!device.setBuffer(pressure_buffer, particles.get(ParticleStore::ChannelPressure))) return false;
+		if(!device.setBuffer(density_buffer, particles.get(ParticleStore::ChannelDensity))) return false;
+
+		// particles start in the loaded order
+		Array<uint32_t> order(num_particles);
+		for(uint32_t i = 0; i < num_particles; i++) order[i] = i;
+		if(!device.setBuffer(order_buffers[0], order.get())) return false;
+		reorder_step = 0;
+
+		return true;
+	}
+
+	/*
+	 */
+	void Simulation::setInteraction(const Vector4f &interaction) {
+		if(interaction_forces.size() == 0) return;
+		interaction_forces[0] = interaction;
+		if(backend == BackendCPU) {
+			cpu_solver.setInteraction(interaction);
+			mpm_solver.setInteraction(interaction);
+		}
+		else if(interaction_buffer) device.setBuffer(interaction_buffer, interaction_forces.get());
+	}
+
+	/*
+	 */
+	void Simulation::setDeterministic(bool enabled, uint32_t interval) {
+		deterministic = enabled;
+		hash_interval = interval;
+		cpu_solver.setDeterministic(enabled);
+	}
+
+	void Simulation::setAdaptiveTimeStep(bool enabled, float32_t c, uint32_t substeps) {
+		adaptive = enabled;
+		cfl = max(c, 1e-3f);
+		max_substeps = max(substeps, 1u);
+	}
+
+	void Simulation::setTimeLevels(uint32_t num, float32_t cfl) {
+		num_levels = max(num, 1u);
+		level_cfl = cfl;
+	}
+
+	void Simulation::setPhysicsParameters(const PhysicsParameters &parameters) {
+		physics = parameters;
+		if(scene_parameters.size() == 0) check_kernel(0);
+		for(uint32_t i = 0; i < scene_parameters.size(); i++) {
+			setSceneParameters(i, parameters);
+		}
+	}
+
+	void Simulation::setSceneParameters(uint32_t scene, const PhysicsParameters &parameters) {
+		TS_ASSERT(scene < getNumScenes());
+		if(scene_parameters.size() == 0) {
+			physics = parameters;
+			check_kernel(scene);
+			return;
+		}
+		scene_parameters[scene] = parameters;
+		check_kernel(scene);
+		update_scene_parameters();
+		if(backend == BackendCPU) cpu_solver.setSceneParameters(solver_parameters.get());
+		else if(scene_buffer) device.setBuffer(scene_buffer, solver_parameters.get());
+	}
+
+	const PhysicsParameters &Simulation::getSceneParameters(uint32_t scene) const {
+		TS_ASSERT(scene < getNumScenes());
+		if(scene_parameters.size() == 0) return physics;
+		return scene_parameters[scene];
+	}
+
+	PhysicsParameters Simulation::get_solver_physics(uint32_t scene) const {
+		PhysicsParameters parameters = getSceneParameters(scene);
+
+		// the resampled lattice is at rest with the particle mass in the cube of the spacing
+		// stiffness and viscosity act on the densities of the same particle mass as the loaded points
+		float32_t spacing = (scene < scene_spacings.size()) ? scene_spacings[scene] : 0.0f;
+		if(spacing > 0.0f) parameters.rest_density = PARTICLE_MASS / (spacing * spacing * spacing);
+
+		return parameters;
+	}
+
+	void Simulation::check_kernel(uint32_t scene) const {
+		if(!created || getSceneParameters(scene).kernel == KernelCubic) return;
+
+		// the shaders and the equation of state pressure use the poly6 and spiky kernels
+		if(backend == BackendGPU || solver != SolverSPH || pressure_solver == CPUSolver::PressureEOS) {
+			TS_LOGF(Warning, "Simulation::check_kernel(): scene %u support kernel is ignored, only the CPU incompressible pressure solvers use it\n", scene);
+		}
+	}
+
+	void Simulation::update_scene_parameters() {
+		solver_parameters.resize(scene_parameters.size());
+		for(uint32_t i = 0; i < scene_parameters.size(); i++) {
+			solver_parameters[i] = get_solver_physics(i);
+		}
+	}
+
+	void Simulation::setPressureSolver(CPUSolver::PressureSolver solver, const CPUSolver::PressureParameters &parameters) {
+		pressure_solver = solver;
+		pressure_parameters = parameters;
+	}
+
+	uint64_t Simulation::getStateHash() const {
+		if(backend != BackendCPU) return 0;
+		if(solver == SolverMPM) return mpm_solver.getStateHash();
+		return cpu_solver.getStateHash();
+	}
+
+	/*
+	 */
+	void Simulation::setReorderInterval(uint32_t interval) {
+		reorder_interval = interval;
+		cpu_solver.setReorderInterval(interval);
+	}
+
+	/*
+	 */
+	void Simulation::setGridBounds(const Vector3f &min, const Vector3f &max) {
+		grid_bounds = true;
+		grid_min = min;
+		grid_max = max;
+	}
+
+	void Simulation::getBoxBounds(const PhysicsParameters &physics, Vector3f &min, Vector3f &max) {
+
+		// box walls padded by the smoothing length, the box is open at the top
+		float32_t box_size = physics.box_size;
+		float32_t padding = physics.smoothing_length;
+		min = Vector3f(-box_size - padding, -box_size - padding, -padding);
+		max = Vector3f(box_size + padding, box_size + padding, box_size * 2.0f + padding);
+	}
+
+	void Simulation::update_grid_bounds() {
+		if(grid_bounds) return;
+
+		// all scenes share the grid
+		getBoxBounds(getSceneParameters(0), grid_min, grid_max);
+		for(uint32_t i = 1; i < getNumScenes(); i++) {
+			Vector3f box_min, box_max;
+			getBoxBounds(getSceneParameters(i), box_min, box_max);
+			grid_min = min(grid_min, box_min);
+			grid_max = max(grid_max, box_max);
+		}
+	}
+
+	float32_t Simulation::getGridScale() const {
+		// stale CPU grids must still cover the search radius
+		float32_t r = search_radius;
+		if(backend == BackendCPU) r += skin;
+		if(stencil == Stencil27) return 1.0f / r;
+		return 0.5f / r;
+	}
+
+	Vector3u Simulation::getGridSize() const {
+		Vector3f extent = (grid_max - grid_min) * getGridScale();
+		return Vector3u(max(ceil(extent), Vector3f(1.0f)));
+	}
+
+	/*
+	 */
+	ComputeParameters Simulation::get_compute_parameters() const {
+		ComputeParameters compute_parameters = {};
+		compute_parameters.size = num_particles;
+		compute_parameters.ifps = ifps;
+		compute_parameters.radius = radius;
+		compute_parameters.grid_scale = getGridScale();
+		compute_parameters.grid_origin = grid_min;
+		compute_parameters.ranges_offset = TS_ALIGN4(num_particles) * 2;
+		compute_parameters.grid_size = getGridSize();
+		compute_parameters.physics = get_solver_physics(0);
+
+		// 27 cells around the particle cell or 8 cells from the half-cell shifted hashes
+		if(stencil == Stencil27) {
+			compute_parameters.stencil_size = 3;
+			compute_parameters.hash_offset = 0.0f;
+			compute_parameters.stencil_offset = -1.0f;
+		} else {
+			compute_parameters.stencil_size = 2;
+			compute_parameters.hash_offset = 0.5f;
+			compute_parameters.stencil_offset = 0.0f;
+		}
+
+		return compute_parameters;
+	}
+
+	/*
+	 */
+	bool Simulation::step(uint32_t num) {
+		if(backend == BackendCPU) return step_cpu(num);
+		return step_gpu(num);
+	}
+
+	bool Simulation::step_cpu(uint32_t num) {
+		ComputeParameters compute_parameters = get_compute_parameters();
+		for(uint32_t i = 0; i < num; i++) {
+			if(solver == SolverMPM) mpm_solver.dispatch(ifps, physics);
+			else if(!adaptive) cpu_solver.dispatch(compute_parameters);
+			else {
+
+				// substeps from the maximums reduced by the previous substep
+				num_substeps = 0;
+				for(float32_t remaining = ifps; remaining > ifps * 1e-4f; num_substeps++) {
+					compute_parameters.ifps = get_substep(remaining, num_substeps);
+					cpu_solver.dispatch(compute_parameters);
+					remaining -= compute_parameters.ifps;
+				}
+				total_substeps += num_substeps;
+			}
+			step_index++;
+
+			// reproducibility checkpoints
+			if(deterministic && hash_interval && step_index % hash_interval == 0) {
+				TS_LOGF(Message, "Simulation::step(): step %u hash %016llx\n", step_index, (unsigned long long)getStateHash());
+			}
+		}
+		return true;
+	}
+
+	float32_t Simulation::get_substep(float32_t remaining, uint32_t substep) const {
+
+		// the last substep covers the rest of the step
+		if(substep + 1 >= max_substeps) return remaining;
+
+		// CFL condition of the particle diameter and the acceleration criterion
+		float32_t diameter = radius * 2.0f;
+		float32_t dt = remaining;
+		float32_t speed = cpu_solver.getMaxSpeed();
+		float32_t acceleration = cpu_solver.getMaxAcceleration();
+		if(speed > 0.0f) dt = min(dt, cfl * diameter / speed);
+		if(acceleration > 0.0f) dt = min(dt, cfl * Tellusim::sqrt(diameter / acceleration));
+
+		// keep enough time for the remaining substeps and split the rest evenly instead of a tiny last substep
+		dt = max(dt, remaining / (max_substeps - substep));
+		if(dt < remaining && dt * 2.0f > remaining) dt = remaining * 0.5f;
+
+		return dt;
+	}
+
+	bool Simulation::step_gpu(uint32_t num) {
+
+		// create command list
+		Compute compute = device.createCompute();
+
+		// compute parameters
+		ComputeParameters compute_parameters = get_compute_parameters();
+
+		for(uint32_t i = 0; i < num; i++) {
+			step_index++;
+
+			// Morton order of the particles
+			if(reorder_interval && ++reorder_step >= reorder_interval) {
+				dispatch_reorder(compute, compute_parameters);
+				reorder_step = 0;
+			}
+
+			// swap buffers
+			swap(position_buffers[0], position_buffers[1]);
+			swap(velocity_buffers[0], velocity_buffers[1]);
+
+			// dispatch pressure/density kernel
+			compute.setKernel(pressure_density);
+			compute.setUniform(0, compute_parameters);
+			compute.setStorageBuffers(0, {
+				spatial_buffer,
+				position_buffers[1], velocity_buffers[1],
+				pressure_buffer, density_buffer,
+				mass_buffer
+			});
+			if(scene_buffer) compute.setStorageBuffer(6, scene_buffer);
+			compute.dispatch(num_particles);
+			compute.barrier({
+				spatial_buffer,
+				position_buffers[1], velocity_buffers[1],
+				pressure_buffer, density_buffer, mass_buffer
+			});
+
+			// dispatch simulation kernel
+			compute.setKernel(kernel);
+			compute.setUniform(0, compute_parameters);
+			compute.setStorageBuffers(0, {
+				spatial_buffer,
+				position_buffers[0], velocity_buffers[0],
+				position_buffers[1], velocity_buffers[1],
+				pressure_buffer, density_buffer,
+				mass_buffer, interaction_buffer
+			});
+			if(scene_buffer) compute.setStorageBuffer(9, scene_buffer);
+			compute.dispatch(num_particles);
+			compute.barrier(spatial_buffer);
+
+			// dispatch spatial grid
+			spatial_grid.dispatch(compute, spatial_buffer, 0, num_particles, grid_bits);
+			compute.barrier({
+				spatial_buffer,
+				position_buffers[0], velocity_buffers[0],
+				position_buffers[1], velocity_buffers[1],
+				pressure_buffer, density_buffer,
+				mass_buffer, interaction_buffer
+			});
+		}
+
+		return true;
+	}
+
+	void Simulation::dispatch_reorder(Compute &compute, const ComputeParameters &compute_parameters) {
+
+		uint32_t values_offset = TS_ALIGN4(num_particles);
+		size_t scalar_bytes = sizeof(float32_t) * num_particles;
+
+		// Morton keys of the current particle cells
+		compute.setKernel(reorder_keys);
+		compute.setUniform(0, compute_parameters);
+		compute.setStorageBuffers(0, { reorder_buffer, position_buffers[0] });
+		compute.dispatch(num_particles);
+		compute.barrier(reorder_buffer);
+
+		// sort particle indices by the keys
+		radix_sort.dispatch(compute, reorder_buffer, 0, values_offset, num_particles, RadixSort::FlagNone, reorder_bits);
+		compute.barrier(reorder_buffer);
+
+		// gather all channels in the sorted order
+		compute.setKernel(reorder_permute);
+		compute.setUniform(0, compute_parameters);
+		compute.setStorageBuffers(0, {
+			reorder_buffer, spatial_buffer,
+			position_buffers[1], velocity_buffers[1],
+			scalar_buffer, order_buffers[1],
+			position_buffers[0], velocity_buffers[0],
+			mass_buffer, density_buffer, pressure_buffer,
+			order_buffers[0]
+		});
+		compute.dispatch(num_particles);
+		compute.barrier({
+			spatial_buffer,
+			position_buffers[1], velocity_buffers[1],
+			scalar_buffer, order_buffers[1]
+		});
+		compute.copyBuffer(mass_buffer, 0, scalar_buffer, sizeof(float32_t) * values_offset * 0, scalar_bytes);
+		compute.copyBuffer(density_buffer, 0, scalar_buffer, sizeof(float32_t) * values_offset * 1, scalar_bytes);
+		compute.copyBuffer(pressure_buffer, 0, scalar_buffer, sizeof(float32_t) * values_offset * 2, scalar_bytes);
+		swap(position_buffers[0], position_buffers[1]);
+		swap(velocity_buffers[0], velocity_buffers[1]);
+		swap(order_buffers[0], order_buffers[1]);
+
+		// spatial grid of the new order
+		spatial_grid.dispatch(compute, spatial_buffer, 0, num_particles, grid_bits);
+		compute.barrier({
+			spatial_buffer,
+			position_buffers[0], velocity_buffers[0],
+			mass_buffer, density_buffer, pressure_buffer
+		});
+	}
+
+	/*
+	 */
+	void Simulation::setNeighborLists(bool enabled, bool distances, size_t max_bytes) {
+		cpu_solver.setNeighborLists(enabled, distances, max_bytes);
+	}
+
+	/*
+	 */
+	bool Simulation::getNeighborStats(CPUSolver::NeighborStats &density, CPUSolver::NeighborStats &force) const {
+		if(backend != BackendCPU || solver != SolverSPH) return false;
+		density = cpu_solver.getDensityStats();
+		force = cpu_solver.getForceStats();
+		return true;
+	}
+
+	uint32_t Simulation::getNumGridRebuilds() const {
+		if(backend != BackendCPU || solver != SolverSPH) return 0;
+		return cpu_solver.getNumRebuilds();
+	}
+
+	bool Simulation::getTimeLevelStats(Array<uint32_t> &counts, uint64_t &num_updates) const {
+		if(backend != BackendCPU || solver != SolverSPH) return false;
+		counts.resize(cpu_solver.getNumTimeLevels());
+		cpu_solver.getTimeLevels(counts.get());
+		num_updates = cpu_solver.getNumUpdates();
+		return true;
+	}
+
+	bool Simulation::getPressureStats(CPUSolver::PressureStats &last, CPUSolver::PressureStats &average) const {
+		if(backend != BackendCPU || solver != SolverSPH || pressure_solver == CPUSolver::PressureEOS) return false;
+		last = cpu_solver.getPressureStats();
+		const CPUSolver::PressureStats &totals = cpu_solver.getPressureTotals();
+		uint32_t num_steps = max(cpu_solver.getNumPressureSteps(), 1u);
+		average.density_iterations = (totals.density_iterations + num_steps / 2) / num_steps;
+		average.divergence_iterations = (totals.divergence_iterations + num_steps / 2) / num_steps;
+		average.density_error = totals.density_error / num_steps;
+		average.divergence_error = totals.divergence_error / num_steps;
+		return true;
+	}
+
+	bool Simulation::getMPMGridStats(uint32_t &num_blocks, size_t &memory, size_t &dense_memory) const {
+		if(backend != BackendCPU || solver != SolverMPM) return false;
+		const SparseGrid &grid = mpm_solver.getGrid();
+		num_blocks = grid.getNumBlocks();
+		memory = grid.getMemory();
+		dense_memory = grid.getDenseMemory();
+		return true;
+	}
+
+	/*
+	 */
+	bool Simulation::readback(Array<Vector4f> &dest_positions, Array<Vector4f> &dest_velocities) {
+		dest_positions.resize(num_particles);
+		dest_velocities.resize(num_particles);
+		if(backend == BackendCPU) {
+			const ParticleStore &src = (solver == SolverMPM) ? mpm_solver.getParticles() : cpu_solver.getParticles();
+			const Array<uint32_t> &order = (solver == SolverMPM) ? mpm_solver.getOrder() : cpu_solver.getOrder();
+			for(uint32_t i = 0; i < num_particles; i++) {
+				dest_positions[order[i]] = Vector4f(src.getPosition(i), 0.0f);
+				dest_velocities[order[i]] = Vector4f(src.getVelocity(i), 0.0f);
+			}
+			return true;
+		}
+		Array<Vector4f> positions(num_particles);
+		Array<Vector4f> velocities(num_particles);
+		Array<uint32_t> order(num_particles);
+		if(!device.getBuffer(position_buffers[0], positions.get(), positions.bytes())) return false;
+		if(!device.getBuffer(velocity_buffers[0], velocities.get(), velocities.bytes())) return false;
+		if(!device.getBuffer(order_buffers[0], order.get(), order.bytes())) return false;
+		for(uint32_t i = 0; i < num_particles; i++) {
+			dest_positions[order[i]] = positions[i];
+			dest_velocities[order[i]] = velocities[i];
+		}
+		return true;
+	}
+
+	bool Simulation::readback(ParticleStore &dest) {
+		if(dest.getSize() != num_particles && !dest.create(num_particles)) return false;
+
+		// particle channels in the simulation order
+		ParticleStore src;
+		Array<uint32_t> order(num_particles);
+		if(backend == BackendCPU) {
+			src.copy((solver == SolverMPM) ? mpm_solver.getParticles() : cpu_solver.getParticles());
+			order.copy((solver == SolverMPM) ? mpm_solver.getOrder() : cpu_solver.getOrder());
+		} else {
+			Array<Vector4f> positions(num_particles);
+			Array<Vector4f> velocities(num_particles);
+			if(!src.create(num_particles)) return false;
+			if(!device.getBuffer(position_buffers[0], positions.get(), positions.bytes())) return false;
+			if(!device.getBuffer(velocity_buffers[0], velocities.get(), velocities.bytes())) return false;
+			if(!device.getBuffer(order_buffers[0], order.get(), order.bytes())) return false;
+			src.setPositions(positions.get());
+			src.setVelocities(velocities.get());
+			if(!device.getBuffer(density_buffer, src.get(ParticleStore::ChannelDensity), sizeof(float32_t) * num_particles)) return false;
+			if(!device.getBuffer(pressure_buffer, src.get(ParticleStore::ChannelPressure), sizeof(float32_t) * num_particles)) return false;
+			if(!device.getBuffer(mass_buffer, src.get(ParticleStore::ChannelMass), sizeof(float32_t) * num_particles)) return false;
+		}
+
+		// scatter into the loaded order
+		for(uint32_t c = 0; c < ParticleStore::NumChannels; c++) {
+			const float32_t *src_channel = src.get((ParticleStore::Channel)c);
+			float32_t *dest_channel = dest.get((ParticleStore::Channel)c);
+			for(uint32_t i = 0; i < num_particles; i++) {
+				dest_channel[order[i]] = src_channel[i];
+			}
+		}
+
+		return true;
+	}
+}
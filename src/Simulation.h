@@ -0,0 +1,330 @@
+#ifndef __MPM_SIMULATION_H__
+#define __MPM_SIMULATION_H__
+
+#include <core/TellusimArray.h>
+#include <core/TellusimAsync.h>
+#include <math/TellusimMath.h>
+#include <platform/TellusimDevice.h>
+#include <platform/TellusimKernel.h>
+#include <platform/TellusimBuffer.h>
+#include <parallel/TellusimPrefixScan.h>
+#include <parallel/TellusimRadixSort.h>
+#include <parallel/TellusimSpatialGrid.h>
+
+#include "Scene.h"
+#include "PointCloud.h"
+#include "PointSampler.h"
+#include "Parameters.h"
+#include "CPUSolver.h"
+#include "MPMSolver.h"
+#include "ParticleStore.h"
+
+/*
+ */
+namespace Mpm {
+
+	/**
+	 * Simulation class
+	 * Particle state and solver step without any window or rendering dependency
+	 */
+	class Simulation {
+
+		public:
+
+			/// Solver backends
+			enum Backend {
+				BackendGPU = 0,
+				BackendCPU,
+				NumBackends,
+			};
+
+			/// Solver models
+			enum Solver {
+				SolverSPH = 0,		// pairwise SPH with contact impulses
+				SolverMPM,			// MLS-MPM with APIC transfers, CPU only
+				NumSolvers,
+			};
+
+			/// Neighbor search stencils
+			enum Stencil {
+				Stencil8 = 0,		// 2x2x2 cells of twice the search radius
+				Stencil27,			// 3x3x3 cells of the search radius
+				NumStencils,
+			};
+
+			/// Input resampling modes
+			enum Sampling {
+				SamplingNone = 0,
+				SamplingGrid,		// voxel centroids of the spacing
+				SamplingPoisson,	// Poisson-disk subset of the number of particles
+				SamplingVolume,		// lattice of the spacing inside the closed surface
+				NumSamplings,
+			};
+
+			Simulation();
+			~Simulation();
+
+			/// clear simulation
+			void clear();
+
+			/// binary point caches of the loaded files and transforms
+			/// caches are written next to the input files on the first load and mapped on the later loads.
+			TS_INLINE void setPointCache(bool enabled) { point_cache = enabled; }
+			TS_INLINE bool isPointCache() const { return point_cache; }
+
+			/// resampling of the loaded points of every scene, applied on load
+			/// resampled particles keep the mass of the loaded points and fall at the same rate,
+			/// the rest density of the solvers is the particle mass in the cube of the spacing.
+			/// \param spacing Voxel size of the grid and volume resampling, zero is the particle diameter.
+			/// \param num_points Number of particles of every scene of the Poisson-disk resampling, particle budget of the volume fill.
+			void setSampling(Sampling mode, float32_t spacing = 0.0f, uint32_t num_points = 0);
+			TS_INLINE Sampling getSampling() const { return sampling; }
+
+			/// load particles from a LAS file
+			/// \param name LAS file name.
+			/// \param transform Scene transform applied to the points.
+			bool load(const char *name, const Matrix4x4f &transform);
+
+			/// load an ensemble of scenes into one particle store
+			/// scenes share the grid bounds but never interact, every scene keeps its physical parameters.
+			/// \param transform Transform applied to the points of all scenes.
+			bool load(const Array<Scene> &scenes, const Matrix4x4f &transform);
+
+			/// create GPU backend
+			/// \param device Device used for the compute kernels and particle buffers.
+			bool create(const Device &device);
+
+			/// create CPU backend
+			/// \param async Async task scheduler used by the CPU solver.
+			bool create(Async &async);
+
+			/// reset particles to the loaded state and clear the solver statistics
+			bool reset();
+
+			/// simulate steps
+			/// GPU commands are recorded but not flushed.
+			bool step(uint32_t num = 1);
+
+			/// read particle state back into host arrays
+			/// particles are returned in the loaded order.
+			bool readback(Array<Vector4f> &positions, Array<Vector4f> &velocities);
+			bool readback(ParticleStore &particles);
+
+			/// simulation parameters
+			/// the time step is locked in the deterministic mode.
+			TS_INLINE void setTimeStep(float32_t step) { if(!deterministic) ifps = step; }
+			TS_INLINE float32_t getTimeStep() const { return ifps; }
+			TS_INLINE float32_t getRadius() const { return radius; }
+
+			/// physical parameters of all scenes, applied on every step without reloading the shaders
+			/// the MPM solver uses the box walls, the gravity and the stiffness as the fluid bulk modulus.
+			/// the grid bounds are kept, larger boxes than the loaded scenes must be covered by setGridBounds() before create.
+			void setPhysicsParameters(const PhysicsParameters &parameters);
+			TS_INLINE const PhysicsParameters &getPhysicsParameters() const { return physics; }
+
+			/// ensemble scenes in the loaded order
+			TS_INLINE uint32_t getNumScenes() const { return max(scene_offsets.size(), 2u) - 1; }
+			TS_INLINE uint32_t getSceneOffset(uint32_t scene) const { return scene_offsets[scene]; }
+			TS_INLINE uint32_t getSceneSize(uint32_t scene) const { return scene_offsets[scene + 1] - scene_offsets[scene]; }
+			void setSceneParameters(uint32_t scene, const PhysicsParameters &parameters);
+			const PhysicsParameters &getSceneParameters(uint32_t scene) const;
+
+			/// CPU adaptive time step of the SPH solver, every step covers the time step in substeps
+			/// substeps are limited by the CFL condition of the particle diameter and by the maximum acceleration.
+			/// \param cfl Fraction of the particle diameter traveled by the fastest particle in one substep.
+			/// \param max_substeps Maximum number of substeps per step, the last substeps cover the rest of the step.
+			void setAdaptiveTimeStep(bool enabled, float32_t cfl = 0.4f, uint32_t max_substeps = 16);
+			TS_INLINE bool isAdaptiveTimeStep() const { return adaptive; }
+			TS_INLINE uint32_t getNumSubsteps() const { return num_substeps; }
+			TS_INLINE uint32_t getTotalSubsteps() const { return total_substeps; }
+
+			/// CPU multi-rate integration of the equation of state pressure, applied on create
+			/// particles are updated at power-of-two fractions of the time step chosen by their CFL limit.
+			/// \param num_levels Number of time step levels, one disables the multi-rate integration.
+			void setTimeLevels(uint32_t num_levels, float32_t cfl = 0.4f);
+			TS_INLINE uint32_t getNumTimeLevels() const { return num_levels; }
+
+			/// solver model, applied on create
+			TS_INLINE void setSolver(Solver s) { solver = s; }
+			TS_INLINE Solver getSolver() const { return solver; }
+
+			/// CPU pressure solver, applied on create
+			/// the kernel support of the incompressible solvers is the search radius, they have no ensemble mode.
+			void setPressureSolver(CPUSolver::PressureSolver solver, const CPUSolver::PressureParameters &parameters);
+			TS_INLINE CPUSolver::PressureSolver getPressureSolver() const { return pressure_solver; }
+
+			/// MPM background grid node spacing, applied on create
+			TS_INLINE void setMPMSpacing(float32_t spacing) { mpm_spacing = spacing; }
+			TS_INLINE float32_t getMPMSpacing() const { return mpm_spacing; }
+
+			/// neighbor search, applied on create
+			/// the grid cell size is derived from the search radius and the stencil.
+			TS_INLINE void setStencil(Stencil s) { stencil = s; }
+			TS_INLINE Stencil getStencil() const { return stencil; }
+			TS_INLINE void setSearchRadius(float32_t r) { search_radius = r; }
+			TS_INLINE float32_t getSearchRadius() const { return search_radius; }
+			float32_t getGridScale() const;
+
+			/// CPU Verlet skin, applied on create
+			/// the grid is kept until a particle moves further than half of the skin, zero rebuilds every step.
+			TS_INLINE void setSkin(float32_t s) { skin = max(s, 0.0f); }
+			TS_INLINE float32_t getSkin() const { return skin; }
+
+			/// Morton reordering of the particle channels
+			/// \param interval Number of steps between the reorderings, zero disables them.
+			void setReorderInterval(uint32_t interval);
+			TS_INLINE uint32_t getReorderInterval() const { return reorder_interval; }
+
+			/// spatial grid bounds, applied on create
+			/// the default bounds cover the box walls of all loaded scenes, particles outside of the bounds are clamped into the border cells.
+			void setGridBounds(const Vector3f &min, const Vector3f &max);
+			static void getBoxBounds(const PhysicsParameters &physics, Vector3f &min, Vector3f &max);
+			TS_INLINE const Vector3f &getGridMin() const { return grid_min; }
+			TS_INLINE const Vector3f &getGridMax() const { return grid_max; }
+			Vector3u getGridSize() const;
+
+			/// CPU deterministic mode with a fixed time step
+			/// \param hash_interval Number of steps between the logged state hashes, zero disables them.
+			void setDeterministic(bool enabled, uint32_t hash_interval = 0);
+			TS_INLINE bool isDeterministic() const { return deterministic; }
+
+			/// CPU particle state hash
+			uint64_t getStateHash() const;
+			TS_INLINE uint32_t getStepIndex() const { return step_index; }
+
+			/// interaction sphere (w is 1 when active)
+			void setInteraction(const Vector4f &interaction);
+
+			/// simulation info
+			TS_INLINE Backend getBackend() const { return backend; }
+			TS_INLINE uint32_t getNumParticles() const { return num_particles; }
+
+			/// loaded particles
+			TS_INLINE const ParticleStore &getParticles() const { return particles; }
+
+			/// CPU neighbor lists shared by the density and force passes
+			/// \param distances Cache neighbor deltas and distances in the lists.
+			/// \param max_bytes Memory budget, the grid is searched when the lists exceed it.
+			void setNeighborLists(bool enabled, bool distances = false, size_t max_bytes = (size_t)512 << 20);
+
+			/// CPU neighbor search statistics
+			bool getNeighborStats(CPUSolver::NeighborStats &density, CPUSolver::NeighborStats &force) const;
+			uint32_t getNumGridRebuilds() const;
+
+			/// CPU particles per time level and particle force updates since the reset
+			bool getTimeLevelStats(Array<uint32_t> &counts, uint64_t &num_updates) const;
+
+			/// CPU pressure solver statistics of the last step and averaged over the steps
+			bool getPressureStats(CPUSolver::PressureStats &last, CPUSolver::PressureStats &average) const;
+
+			/// MPM background grid memory of the active blocks and of the dense grid
+			bool getMPMGridStats(uint32_t &num_blocks, size_t &memory, size_t &dense_memory) const;
+
+			/// GPU particle buffers of the current state in the simulation order
+			/// the w component of the positions is the scene of the particle.
+			TS_INLINE Buffer &getPositionBuffer() { return position_buffers[0]; }
+			TS_INLINE Buffer &getVelocityBuffer() { return velocity_buffers[0]; }
+
+		private:
+
+			/// warn when the created solvers ignore the support kernel of the scene
+			void check_kernel(uint32_t scene) const;
+
+			/// physical parameters of the scene scaled to the resampling spacing
+			PhysicsParameters get_solver_physics(uint32_t scene) const;
+			void update_scene_parameters();
+
+			/// compute parameters of the current step
+			ComputeParameters get_compute_parameters() const;
+
+			/// box bounds of the loaded scenes unless the grid bounds are set
+			void update_grid_bounds();
+
+			/// upload loaded particles into the GPU buffers
+			bool upload_particles();
+
+			/// backend steps
+			bool step_gpu(uint32_t num);
+			bool step_cpu(uint32_t num);
+
+			/// next adaptive substep from the maximums of the last substep
+			float32_t get_substep(float32_t remaining, uint32_t substep) const;
+
+			/// permute GPU particle buffers into the Morton order
+			void dispatch_reorder(Compute &compute, const ComputeParameters &compute_parameters);
+
+			Backend backend = BackendGPU;
+			bool created = false;
+			Solver solver = SolverSPH;
+			CPUSolver::PressureSolver pressure_solver = CPUSolver::PressureEOS;
+			CPUSolver::PressureParameters pressure_parameters;
+
+			// spatial parameters
+			uint32_t group_size = 128;
+			uint32_t grid_bits = 0;
+			float32_t radius = 0.06f;
+			float32_t ifps = 1.0f / 50.0f;
+			PhysicsParameters physics;
+			bool adaptive = false;
+			float32_t cfl = 0.4f;
+			uint32_t max_substeps = 16;
+			uint32_t num_substeps = 0;			// substeps of the last step
+			uint32_t total_substeps = 0;		// substeps since the last reset
+			uint32_t num_levels = 1;
+			float32_t level_cfl = 0.4f;
+			bool deterministic = false;
+			uint32_t hash_interval = 0;
+			uint32_t step_index = 0;			// steps since the last reset
+			Stencil stencil = Stencil8;
+			float32_t search_radius = 0.12f;	// particle contact distance
+			float32_t skin = 0.0f;
+			float32_t mpm_spacing = 0.12f;		// twice the particle radius
+			uint32_t reorder_interval = 0;
+			uint32_t reorder_step = 0;
+			uint32_t reorder_bits = 0;
+			bool grid_bounds = false;			// bounds of setGridBounds()
+			Vector3f grid_min = Vector3f(0.0f);
+			Vector3f grid_max = Vector3f(0.0f);
+
+			// loaded particles
+			bool point_cache = true;
+			Sampling sampling = SamplingNone;
+			float32_t sampling_spacing = 0.0f;
+			uint32_t sampling_points = 0;
+			uint32_t num_particles = 0;
+			ParticleStore particles;
+			Array<uint32_t> scene_offsets;		// first particle of every scene and the number of particles
+			Array<uint32_t> scene_ids;			// particle scenes of an ensemble
+			Array<PhysicsParameters> scene_parameters;
+			Array<float32_t> scene_spacings;	// resampling spacing of every scene, zero keeps the parameters
+			Array<PhysicsParameters> solver_parameters;	// ensemble parameters of the solvers
+			Array<Vector4f> interaction_forces;
+
+			// GPU backend
+			Device device;
+			Kernel kernel;
+			Kernel pressure_density;
+			Kernel reorder_keys;
+			Kernel reorder_permute;
+			Buffer position_buffers[2];
+			Buffer velocity_buffers[2];
+			Buffer density_buffer;
+			Buffer pressure_buffer;
+			Buffer mass_buffer;
+			Buffer interaction_buffer;
+			Buffer scene_buffer;
+			Buffer spatial_buffer;
+			Buffer order_buffers[2];
+			Buffer reorder_buffer;
+			Buffer scalar_buffer;
+			RadixSort radix_sort;
+			PrefixScan prefix_scan;
+			SpatialGrid spatial_grid;
+
+			// CPU backend
+			CPUSolver cpu_solver;
+			MPMSolver mpm_solver;
+	};
+}
+
+#endif /* __MPM_SIMULATION_H__ */
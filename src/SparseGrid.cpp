@@ -0,0 +1,188 @@
+#include "SparseGrid.h"
+
+#include <core/TellusimLog.h>
+
+/*
+ */
+namespace Mpm {
+
+	/*
+	 */
+	static TS_INLINE Vector3u get_block(const Vector3u &index) {
+		return Vector3u(index.x >> SparseGrid::BlockBits, index.y >> SparseGrid::BlockBits, index.z >> SparseGrid::BlockBits);
+	}
+
+	/*
+	 */
+	SparseGrid::SparseGrid() {
+
+	}
+
+	SparseGrid::~SparseGrid() {
+
+	}
+
+	/*
+	 */
+	void SparseGrid::clear() {
+		size = Vector3u(0u);
+		table_keys.clear();
+		table_blocks.clear();
+		table_slots.clear();
+		table_mask = 0;
+		table_shift = 32;
+		blocks.clear();
+		coords.clear();
+	}
+
+	/*
+	 */
+	bool SparseGrid::create(const Vector3u &s) {
+
+		clear();
+
+		// check parameters
+		Vector3u num_blocks = get_block(s + Vector3u(BlockMask));
+		if(s.x == 0 || s.y == 0 || s.z == 0 || num_blocks.x >= MaxBlocks || num_blocks.y >= MaxBlocks || num_blocks.z >= MaxBlocks) {
+			TS_LOGF(Error, "SparseGrid::create(): invalid grid size %ux%ux%u\n", s.x, s.y, s.z);
+			return false;
+		}
+
+		size = s;
+
+		// grows with the number of active blocks
+		resize_table(1024);
+		blocks.resize(256);
+
+		return true;
+	}
+
+	/*
+	 */
+	void SparseGrid::reset() {
+
+		// blocks are handed out from the first one again
+		for(uint32_t slot : table_slots) {
+			table_keys[slot] = Maxu32;
+		}
+		table_slots.clear();
+		coords.clear();
+	}
+
+	/*
+	 */
+	uint32_t SparseGrid::insert(uint32_t key, const Vector3u &block) {
+
+		// keep the page table at most half full
+		if((coords.size() + 1) * 2 > table_keys.size()) resize_table(table_keys.size() * 2);
+
+		uint32_t slot = get_slot(key);
+		for(; table_keys[slot] != Maxu32; slot = (slot + 1) & table_mask) {
+			if(table_keys[slot] == key) return table_blocks[slot];
+		}
+
+		// allocate zero block
+		uint32_t index = coords.size();
+		if(index == blocks.size()) blocks.resize(blocks.size() * 2);
+		memset((void*)blocks[index].nodes, 0, sizeof(Block));
+
+		table_keys[slot] = key;
+		table_blocks[slot] = index;
+		table_slots.append(slot);
+		coords.append(block);
+
+		return index;
+	}
+
+	void SparseGrid::resize_table(uint32_t capacity) {
+
+		// rehash the active blocks
+		table_keys.resize(capacity);
+		table_blocks.resize(capacity);
+		table_mask = capacity - 1;
+		for(table_shift = 32; (1u << (32 - table_shift)) < capacity; table_shift--);
+		for(uint32_t &key : table_keys) key = Maxu32;
+		table_slots.clear();
+		for(uint32_t i = 0; i < coords.size(); i++) {
+			uint32_t key = get_key(coords[i]);
+			uint32_t slot = get_slot(key);
+			while(table_keys[slot] != Maxu32) slot = (slot + 1) & table_mask;
+			table_keys[slot] = key;
+			table_blocks[slot] = i;
+			table_slots.append(slot);
+		}
+	}
+
+	/*
+	 */
+	void SparseGrid::activate(const Vector3u &base) {
+		Vector3u begin = get_block(base);
+		Vector3u end = get_block(min(base + Vector3u(2u), size - Vector3u(1u)));
+
+		// neighboring particles share their blocks
+		if(coords.size() && begin == last_begin && end == last_end) return;
+		last_begin = begin;
+		last_end = end;
+		for(uint32_t z = begin.z; z <= end.z; z++) {
+			for(uint32_t y = begin.y; y <= end.y; y++) {
+				for(uint32_t x = begin.x; x <= end.x; x++) {
+					Vector3u block = Vector3u(x, y, z);
+					insert(get_key(block), block);
+				}
+			}
+		}
+	}
+
+	void SparseGrid::getWindow(const Vector3u &block, Vector4f *nodes, uint32_t window) {
+		TS_ASSERT(window <= BlockSize * 2 && "SparseGrid::getWindow(): invalid window size");
+		for(uint32_t z = 0; z < window; z += BlockSize) {
+			for(uint32_t y = 0; y < window; y += BlockSize) {
+				for(uint32_t x = 0; x < window; x += BlockSize) {
+					uint32_t index = find(get_key(block + Vector3u(x, y, z) / (uint32_t)BlockSize));
+					const Block *src = (index != Maxu32) ? &blocks[index] : nullptr;
+					for(uint32_t Z = z; Z < min(z + BlockSize, window); Z++) {
+						for(uint32_t Y = y; Y < min(y + BlockSize, window); Y++) {
+							Vector4f *dest = nodes + window * (window * Z + Y) + x;
+							const Vector4f *row = (src) ? src->nodes + BlockSize * (BlockSize * (Z - z) + (Y - y)) : nullptr;
+							for(uint32_t X = 0; X < min((uint32_t)BlockSize, window - x); X++) {
+								dest[X] = (row) ? row[X] : Vector4f(0.0f);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void SparseGrid::addWindow(const Vector3u &block, const Vector4f *nodes, uint32_t window) {
+		TS_ASSERT(window <= BlockSize * 2 && "SparseGrid::addWindow(): invalid window size");
+		for(uint32_t z = 0; z < window; z += BlockSize) {
+			for(uint32_t y = 0; y < window; y += BlockSize) {
+				for(uint32_t x = 0; x < window; x += BlockSize) {
+					uint32_t index = find(get_key(block + Vector3u(x, y, z) / (uint32_t)BlockSize));
+					if(index == Maxu32) continue;
+					Block &dest = blocks[index];
+					for(uint32_t Z = z; Z < min(z + BlockSize, window); Z++) {
+						for(uint32_t Y = y; Y < min(y + BlockSize, window); Y++) {
+							const Vector4f *src = nodes + window * (window * Z + Y) + x;
+							Vector4f *row = dest.nodes + BlockSize * (BlockSize * (Z - z) + (Y - y));
+							for(uint32_t X = 0; X < min((uint32_t)BlockSize, window - x); X++) {
+								row[X] += src[X];
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/*
+	 */
+	size_t SparseGrid::getMemory() const {
+		return blocks.bytes() + table_keys.bytes() + table_blocks.bytes() + table_slots.bytes() + coords.bytes();
+	}
+
+	size_t SparseGrid::getDenseMemory() const {
+		return sizeof(Vector4f) * size.x * size.y * size.z;
+	}
+}
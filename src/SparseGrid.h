@@ -0,0 +1,97 @@
+#ifndef __MPM_SPARSE_GRID_H__
+#define __MPM_SPARSE_GRID_H__
+
+#include <core/TellusimArray.h>
+#include <math/TellusimMath.h>
+
+/*
+ */
+namespace Mpm {
+
+	using namespace Tellusim;
+
+	/**
+	 * SparseGrid class
+	 * Grid nodes allocated in leaf blocks of BlockSize^3 nodes and indexed by a hashed page table
+	 */
+	class SparseGrid {
+
+		public:
+
+			enum {
+				BlockBits = 2,
+				BlockSize = 1 << BlockBits,
+				BlockMask = BlockSize - 1,
+				BlockNodes = BlockSize * BlockSize * BlockSize,
+				MaxBlocks = 1 << 10,				// blocks along each axis
+			};
+
+			/// Leaf block of x-major nodes
+			struct Block {
+				Vector4f nodes[BlockNodes];
+			};
+
+			SparseGrid();
+			~SparseGrid();
+
+			/// clear grid
+			void clear();
+
+			/// create grid
+			/// \param size Number of nodes along each axis.
+			bool create(const Vector3u &size);
+
+			/// release all blocks, the page table and block memory are kept
+			void reset();
+
+			/// activate blocks covering the 3x3x3 node stencil
+			void activate(const Vector3u &base);
+
+			/// dense window of nodes starting at a block corner and spanning at most two blocks per axis
+			/// \param nodes Window nodes in x-major order, nodes of inactive blocks are zero.
+			void getWindow(const Vector3u &block, Vector4f *nodes, uint32_t size);
+			/// \param nodes Window nodes added to the active blocks, nodes of inactive blocks must be zero.
+			void addWindow(const Vector3u &block, const Vector4f *nodes, uint32_t size);
+
+			/// active blocks
+			TS_INLINE uint32_t getNumBlocks() const { return coords.size(); }
+			TS_INLINE Block &getBlock(uint32_t index) { return blocks[index]; }
+			TS_INLINE const Vector3u &getBlockCoord(uint32_t index) const { return coords[index]; }
+
+			/// grid parameters
+			TS_INLINE const Vector3u &getSize() const { return size; }
+			size_t getMemory() const;
+			size_t getDenseMemory() const;
+
+		private:
+
+			/// page table
+			TS_INLINE uint32_t get_key(const Vector3u &block) const { return (block.z << 20) | (block.y << 10) | block.x; }
+			TS_INLINE uint32_t get_slot(uint32_t key) const { return (key * 2654435761u) >> table_shift; }
+			TS_INLINE uint32_t find(uint32_t key) const {
+				for(uint32_t slot = get_slot(key);; slot = (slot + 1) & table_mask) {
+					if(table_keys[slot] == key) return table_blocks[slot];
+					if(table_keys[slot] == Maxu32) return Maxu32;
+				}
+			}
+			uint32_t insert(uint32_t key, const Vector3u &block);
+			void resize_table(uint32_t capacity);
+
+			Vector3u size = Vector3u(0u);
+
+			// open addressing page table of block keys and block indices
+			Array<uint32_t> table_keys;
+			Array<uint32_t> table_blocks;
+			Array<uint32_t> table_slots;		// page table slots of the active blocks
+			uint32_t table_mask = 0;
+			uint32_t table_shift = 32;			// high product bits of the multiplicative hash
+
+			// leaf blocks, the first coords.size() blocks are active and the rest are kept for the next steps
+			Array<Block> blocks;
+			Array<Vector3u> coords;				// active block coordinates
+			Vector3u last_begin = Vector3u(0u);	// blocks of the last activated stencil
+			Vector3u last_end = Vector3u(0u);
+	};
+}
+
+#endif /* __MPM_SPARSE_GRID_H__ */
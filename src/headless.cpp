@@ -0,0 +1,316 @@
+#include <TellusimApp.h>
+#include <core/TellusimLog.h>
+#include <core/TellusimTime.h>
+#include <core/TellusimAsync.h>
+#include <math/TellusimMath.h>
+#include <platform/TellusimContext.h>
+#include <platform/TellusimDevice.h>
+#include <platform/TellusimShader.h>
+
+#include "Scene.h"
+#include "Simulation.h"
+
+using namespace Tellusim;
+using namespace Mpm;
+
+/*
+ */
+static void get_motion(const Array<Vector4f> &positions, const Array<Vector4f> &velocities, uint32_t offset, uint32_t size, Vector3f &center, float32_t &speed) {
+	center = Vector3f(0.0f);
+	speed = 0.0f;
+	for(uint32_t i = offset; i < offset + size; i++) {
+		center += Vector3f(positions[i]);
+		speed += length(Vector3f(velocities[i]));
+	}
+	center /= (float32_t)max(size, 1u);
+	speed /= (float32_t)max(size, 1u);
+}
+
+/*
+ */
+static bool check_fall(const Scene &scene, const Matrix4x4f &transform, bool point_cache, Simulation::Sampling sampling, float32_t spacing, uint32_t num_points, float32_t ifps) {
+
+	// the loaded and the resampled points fall from rest at the same rate until they reach the floor
+	const uint32_t num_steps = 10;
+	float32_t speeds[2] = {};
+	for(uint32_t i = 0; i < 2; i++) {
+		Async async;
+		Simulation simulation;
+		simulation.setPointCache(point_cache);
+		simulation.setSampling((i) ? sampling : Simulation::SamplingNone, spacing, num_points);
+		if(!simulation.load(Array<Scene>(1, scene), transform)) return false;
+		simulation.setTimeStep(ifps);
+		if(!simulation.create(async) || !simulation.step(num_steps)) return false;
+		Array<Vector4f> positions;
+		Array<Vector4f> velocities;
+		if(!simulation.readback(positions, velocities)) return false;
+		for(const Vector4f &velocity : velocities) speeds[i] += velocity.z;
+		speeds[i] /= (float32_t)max(velocities.size(), 1u);
+	}
+
+	TS_LOGF(Message, "fall: %f loaded, %f resampled\n", speeds[0], speeds[1]);
+	if(Tellusim::abs(speeds[1] - speeds[0]) > Tellusim::abs(speeds[0]) * 0.01f) {
+		TS_LOG(Error, "fall: resampled particles fall at another rate\n");
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ */
+static void print_stats(const Simulation &simulation, Simulation::Backend backend, uint32_t num_steps, uint32_t num_levels) {
+
+	// neighbor search efficiency
+	CPUSolver::NeighborStats density_stats, force_stats;
+	if(simulation.getNeighborStats(density_stats, force_stats)) {
+		TS_LOGF(Message, "density: %llu candidates, %llu neighbors (%.1f%%)\n", (unsigned long long)density_stats.candidates, (unsigned long long)density_stats.neighbors, 100.0 * density_stats.neighbors / max(density_stats.candidates, (uint64_t)1));
+		TS_LOGF(Message, "force: %llu candidates, %llu neighbors (%.1f%%)\n", (unsigned long long)force_stats.candidates, (unsigned long long)force_stats.neighbors, 100.0 * force_stats.neighbors / max(force_stats.candidates, (uint64_t)1));
+		TS_LOGF(Message, "grid: %u rebuilds\n", simulation.getNumGridRebuilds());
+		TS_LOGF(Message, "state hash: %016llx\n", (unsigned long long)simulation.getStateHash());
+	}
+
+	// adaptive time step
+	if(simulation.isAdaptiveTimeStep() && backend == Simulation::BackendCPU) {
+		TS_LOGF(Message, "substeps: %u last step, %.2f average\n", simulation.getNumSubsteps(), (float64_t)simulation.getTotalSubsteps() / max(num_steps, 1u));
+	}
+
+	// multi-rate integration work
+	Array<uint32_t> level_counts;
+	uint64_t num_updates = 0;
+	if(num_levels > 1 && simulation.getTimeLevelStats(level_counts, num_updates)) {
+		String counts;
+		for(uint32_t count : level_counts) counts += String::format(" %u", count);
+		TS_LOGF(Message, "time levels:%s, %.2f updates per particle step\n", counts.get(), (float64_t)num_updates / ((float64_t)simulation.getNumParticles() * max(num_steps, 1u)));
+	}
+
+	// pressure solver convergence
+	CPUSolver::PressureStats pressure_stats, average_stats;
+	if(simulation.getPressureStats(pressure_stats, average_stats)) {
+		TS_LOGF(Message, "pressure: %u divergence iterations (%.4f), %u density iterations (%.5f)\n", pressure_stats.divergence_iterations, pressure_stats.divergence_error, pressure_stats.density_iterations, pressure_stats.density_error);
+		TS_LOGF(Message, "pressure average: %u divergence iterations (%.4f), %u density iterations (%.5f)\n", average_stats.divergence_iterations, average_stats.divergence_error, average_stats.density_iterations, average_stats.density_error);
+	}
+
+	// sparse grid memory
+	uint32_t num_blocks = 0;
+	size_t grid_memory = 0, dense_memory = 0;
+	if(simulation.getMPMGridStats(num_blocks, grid_memory, dense_memory)) {
+		TS_LOGF(Message, "grid: %u blocks, %.1f MB (dense %.1f MB)\n", num_blocks, grid_memory / 1048576.0, dense_memory / 1048576.0);
+		TS_LOGF(Message, "state hash: %016llx\n", (unsigned long long)simulation.getStateHash());
+	}
+}
+
+/*
+ */
+int32_t main(int32_t argc, char **argv) {
+
+	// command line
+	Simulation::Backend backend = Simulation::BackendGPU;
+	const char *name = "../src/models/dragon_100k.las";
+	const char *scene_name = nullptr;
+	const char *sweep_name = nullptr;
+	uint32_t num_steps = 1000;
+	uint32_t batch_size = 10;
+	float32_t ifps = 1.0f / 50.0f;
+	float32_t search_radius = 0.0f;
+	float32_t skin = 0.0f;
+	uint32_t reorder_interval = 0;
+	bool deterministic = false;
+	bool adaptive = false;
+	bool ensemble = false;
+	bool point_cache = true;
+	bool fall = false;
+	Simulation::Sampling sampling = Simulation::SamplingNone;
+	float32_t sampling_spacing = 0.0f;
+	uint32_t sampling_points = 0;
+	float32_t cfl = 0.4f;
+	uint32_t max_substeps = 16;
+	uint32_t num_levels = 1;
+	Simulation::Solver solver = Simulation::SolverSPH;
+	CPUSolver::PressureSolver pressure_solver = CPUSolver::PressureEOS;
+	CPUSolver::PressureParameters pressure_parameters;
+	const char *kernel_name = nullptr;
+	float32_t mpm_spacing = 0.0f;
+	uint32_t hash_interval = 0;
+	Simulation::Stencil stencil = Simulation::Stencil8;
+	bool lists = false;
+	bool distances = false;
+	uint32_t list_budget = 512;
+	for(int32_t i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--backend=cpu")) backend = Simulation::BackendCPU;
+		else if(!strcmp(argv[i], "--backend=gpu")) backend = Simulation::BackendGPU;
+		else if(!strcmp(argv[i], "--lists")) lists = true;
+		else if(!strcmp(argv[i], "--lists=distances")) lists = distances = true;
+		else if(!strcmp(argv[i], "--deterministic")) deterministic = true;
+		else if(!strcmp(argv[i], "--adaptive")) adaptive = true;
+		else if(!strcmp(argv[i], "--ensemble")) ensemble = true;
+		else if(!strcmp(argv[i], "--no-cache")) point_cache = false;
+		else if(!strcmp(argv[i], "--resample=grid")) sampling = Simulation::SamplingGrid;
+		else if(!strcmp(argv[i], "--resample=poisson")) sampling = Simulation::SamplingPoisson;
+		else if(!strcmp(argv[i], "--resample=volume")) sampling = Simulation::SamplingVolume;
+		else if(!strcmp(argv[i], "--check-fall")) fall = true;
+		else if(!strcmp(argv[i], "--solver=sph")) solver = Simulation::SolverSPH;
+		else if(!strcmp(argv[i], "--solver=mpm")) solver = Simulation::SolverMPM;
+		else if(!strcmp(argv[i], "--pressure=eos")) pressure_solver = CPUSolver::PressureEOS;
+		else if(!strcmp(argv[i], "--pressure=dfsph")) pressure_solver = CPUSolver::PressureDFSPH;
+		else if(!strcmp(argv[i], "--pressure=iisph")) pressure_solver = CPUSolver::PressureIISPH;
+		else if(!strncmp(argv[i], "--kernel=", 9)) kernel_name = argv[i] + 2;
+		else if(!strcmp(argv[i], "--tabulated")) pressure_parameters.tabulated = true;
+		else if(i + 1 < argc) {
+			if(!strcmp(argv[i], "-input")) name = argv[++i];
+			else if(!strcmp(argv[i], "-scene")) scene_name = argv[++i];
+			else if(!strcmp(argv[i], "-sweep")) sweep_name = argv[++i];
+			else if(!strcmp(argv[i], "-steps")) num_steps = String::tou32(argv[++i]);
+			else if(!strcmp(argv[i], "-batch")) batch_size = max(String::tou32(argv[++i]), 1u);
+			else if(!strcmp(argv[i], "-ifps")) ifps = String::tof32(argv[++i]);
+			else if(!strcmp(argv[i], "-stencil")) stencil = (String::tou32(argv[++i]) == 27) ? Simulation::Stencil27 : Simulation::Stencil8;
+			else if(!strcmp(argv[i], "-search")) search_radius = String::tof32(argv[++i]);
+			else if(!strcmp(argv[i], "-skin")) skin = String::tof32(argv[++i]);
+			else if(!strcmp(argv[i], "-reorder")) reorder_interval = String::tou32(argv[++i]);
+			else if(!strcmp(argv[i], "-hash")) hash_interval = String::tou32(argv[++i]);
+			else if(!strcmp(argv[i], "-spacing")) mpm_spacing = String::tof32(argv[++i]);
+			else if(!strcmp(argv[i], "-resample-spacing")) sampling_spacing = String::tof32(argv[++i]);
+			else if(!strcmp(argv[i], "-particles")) sampling_points = String::tou32(argv[++i]);
+			else if(!strcmp(argv[i], "-budget")) list_budget = String::tou32(argv[++i]);
+			else if(!strcmp(argv[i], "-tolerance")) pressure_parameters.density_tolerance = String::tof32(argv[++i]);
+			else if(!strcmp(argv[i], "-divergence")) pressure_parameters.divergence_tolerance = String::tof32(argv[++i]);
+			else if(!strcmp(argv[i], "-iterations")) pressure_parameters.max_density_iterations = pressure_parameters.max_divergence_iterations = String::tou32(argv[++i]);
+			else if(!strcmp(argv[i], "-relaxation")) pressure_parameters.relaxation = String::tof32(argv[++i]);
+			else if(!strcmp(argv[i], "-cfl")) cfl = String::tof32(argv[++i]);
+			else if(!strcmp(argv[i], "-substeps")) max_substeps = String::tou32(argv[++i]);
+			else if(!strcmp(argv[i], "-levels")) num_levels = String::tou32(argv[++i]);
+		}
+	}
+
+	// scene input and physical parameters
+	Scene scene;
+	if(scene_name) {
+		if(!scene.load(scene_name)) return 1;
+		if(scene.getInput()) name = scene.getInput().get();
+	}
+	if(kernel_name && !scene.parse(kernel_name)) return 1;
+
+	// parameter sets of the sweep, all sets run from the loaded state in one process
+	Array<PhysicsParameters> sweep_sets;
+	if(sweep_name) {
+		if(!scene.loadSweep(sweep_name, sweep_sets)) return 1;
+		TS_LOGF(Message, "sweep: %u parameter sets\n", sweep_sets.size());
+	}
+	if(sweep_sets.size() == 0) sweep_sets.append(scene.getPhysics());
+
+	// ensemble runs all sweep sets as independent scenes of one simulation
+	Array<Scene> scenes;
+	if(ensemble) {
+		scene.setInput(name);
+		scenes.resize(sweep_sets.size(), scene);
+		for(uint32_t i = 0; i < scenes.size(); i++) scenes[i].setPhysics(sweep_sets[i]);
+		sweep_sets.resize(1);
+	}
+
+	// load particles
+	Simulation simulation;
+	simulation.setPointCache(point_cache);
+	simulation.setSampling(sampling, sampling_spacing, sampling_points);
+	Matrix4x4f transform = Matrix4x4f::translate(0.0f, 0.0f, 3.2f) * Matrix4x4f::scale(0.03f) * Matrix4x4f::rotateZ(90.0f) * Matrix4x4f::rotateX(80.0f);
+	if(fall && sampling != Simulation::SamplingNone) {
+		scene.setInput(name);
+		if(!check_fall(scene, transform, point_cache, sampling, sampling_spacing, sampling_points, ifps)) return 1;
+	}
+	if(ensemble) {
+		if(!simulation.load(scenes, transform)) return 1;
+		TS_LOGF(Message, "ensemble: %u scenes\n", simulation.getNumScenes());
+	} else {
+		scene.setInput(name);
+		if(!simulation.load(Array<Scene>(1, scene), transform)) return 1;
+	}
+	simulation.setTimeStep(ifps);
+	simulation.setStencil(stencil);
+	if(search_radius > 0.0f) simulation.setSearchRadius(search_radius);
+	simulation.setSkin(skin);
+	simulation.setReorderInterval(reorder_interval);
+	simulation.setDeterministic(deterministic, hash_interval);
+	simulation.setAdaptiveTimeStep(adaptive, cfl, max_substeps);
+	simulation.setTimeLevels(num_levels, cfl);
+	simulation.setSolver(solver);
+	simulation.setPressureSolver(pressure_solver, pressure_parameters);
+	if(mpm_spacing > 0.0f) simulation.setMPMSpacing(mpm_spacing);
+
+	// sweep sets share the grid of their largest box
+	if(sweep_sets.size() > 1) {
+		Vector3f grid_min, grid_max;
+		Simulation::getBoxBounds(sweep_sets[0], grid_min, grid_max);
+		for(uint32_t i = 1; i < sweep_sets.size(); i++) {
+			Vector3f box_min, box_max;
+			Simulation::getBoxBounds(sweep_sets[i], box_min, box_max);
+			grid_min = min(grid_min, box_min);
+			grid_max = max(grid_max, box_max);
+		}
+		simulation.setGridBounds(grid_min, grid_max);
+	}
+
+	// create simulation
+	App app(argc, argv);
+	Context context;
+	Device device;
+	Async async;
+	if(backend == Simulation::BackendCPU) {
+		if(!simulation.create(async)) return 1;
+		simulation.setNeighborLists(lists, distances, (size_t)list_budget << 20);
+		TS_LOGF(Message, "CPU backend: %u threads\n", async.getNumThreads());
+	} else {
+		if(!app.create()) return 1;
+		context = Context(app.getPlatform(), app.getDevice());
+		if(!context || !context.create()) return 1;
+		device = Device(context);
+		if(!device) return 1;
+		Shader::setCache("headless.cache");
+		if(!simulation.create(device)) return 1;
+		TS_LOGF(Message, "GPU backend: %s\n", context.getPlatformName());
+	}
+
+	// simulate
+	Vector3f center = Vector3f(0.0f);
+	float32_t speed = 0.0f;
+	for(uint32_t set = 0; set < sweep_sets.size(); set++) {
+		const PhysicsParameters &physics = sweep_sets[set];
+		if(set && !simulation.reset()) return 1;
+		if(!ensemble || simulation.getNumScenes() == 1) simulation.setPhysicsParameters(physics);
+
+		uint64_t begin = Time::current();
+		for(uint32_t step = 0; step < num_steps; step += batch_size) {
+			if(!simulation.step(min(batch_size, num_steps - step))) return 1;
+			if(backend == Simulation::BackendGPU) {
+				if(!device.flush()) return 1;
+				if(!device.check()) return 1;
+			}
+		}
+		if(backend == Simulation::BackendGPU && !device.finish()) return 1;
+		float64_t time = (float64_t)(Time::current() - begin) / (float64_t)Time::Seconds;
+
+		// read back state
+		Array<Vector4f> positions;
+		Array<Vector4f> velocities;
+		if(!simulation.readback(positions, velocities)) return 1;
+		get_motion(positions, velocities, 0, positions.size(), center, speed);
+		if(ensemble) {
+			TS_LOGF(Message, "%u particles, %u scenes, %u steps, %.3f s, %.3f ms/step\n", simulation.getNumParticles(), simulation.getNumScenes(), num_steps, time, time * 1000.0 / max(num_steps, 1u));
+			for(uint32_t i = 0; i < simulation.getNumScenes(); i++) {
+				const PhysicsParameters &parameters = simulation.getSceneParameters(i);
+				get_motion(positions, velocities, simulation.getSceneOffset(i), simulation.getSceneSize(i), center, speed);
+				TS_LOGF(Message, "scene %u: viscosity %g, stiffness %g, gravity %g, center: %f %f %f, mean speed: %f\n", i, parameters.viscosity, parameters.stiffness, parameters.gravity, center.x, center.y, center.z, speed);
+			}
+		} else if(sweep_name) {
+			TS_LOGF(Message, "set %u: stiffness %g, rest density %g, density length %g, viscosity %g, smoothing length %g, box size %g, gravity %g\n", set,
+				physics.stiffness, physics.rest_density, physics.density_length, physics.viscosity, physics.smoothing_length, physics.box_size, physics.gravity);
+			TS_LOGF(Message, "set %u: %.3f s, center: %f %f %f, mean speed: %f, state hash: %016llx\n", set, time, center.x, center.y, center.z, speed, (unsigned long long)simulation.getStateHash());
+		} else {
+			TS_LOGF(Message, "%u particles, %u steps, %.3f s, %.3f ms/step\n", simulation.getNumParticles(), num_steps, time, time * 1000.0 / max(num_steps, 1u));
+			TS_LOGF(Message, "center: %f %f %f, mean speed: %f\n", center.x, center.y, center.z, speed);
+		}
+
+		// statistics of the set, the reset of the next set clears them
+		print_stats(simulation, backend, num_steps, num_levels);
+	}
+
+	return 0;
+}
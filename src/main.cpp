@@ -1,87 +1,96 @@
 #include <common.h>
 #include <math/TellusimMath.h>
+#include <core/TellusimAsync.h>
 #include <platform/TellusimDevice.h>
 #include <platform/TellusimPipeline.h>
-#include <platform/TellusimKernel.h>
 #include <platform/TellusimCommand.h>
-#include <platform/TellusimCompute.h>
-#include <parallel/TellusimPrefixScan.h>
-#include <parallel/TellusimRadixSort.h>
-#include <parallel/TellusimSpatialGrid.h>
 #include <iostream>
 
-#include <io/LasReader.hpp>
-#include <pdal/Writer.hpp>
-#include <pdal/Streamable.hpp>
-#include <pdal/PointView.hpp>
-#include <pdal/util/ProgramArgs.hpp>
+#include "Scene.h"
+#include "Simulation.h"
 
 using namespace Tellusim;
+using namespace Mpm;
 
 int32_t main(int32_t argc, char **argv) {
 	
 	DECLARE_WINDOW
 	
+	// solver backend
+	Simulation::Backend backend = Simulation::BackendGPU;
+	bool deterministic = false;
+	bool adaptive = false;
+	uint32_t num_levels = 1;
+	Simulation::Solver solver = Simulation::SolverSPH;
+	CPUSolver::PressureSolver pressure_solver = CPUSolver::PressureEOS;
+	CPUSolver::PressureParameters pressure_parameters;
+	const char *kernel_name = nullptr;
+	Simulation::Sampling sampling = Simulation::SamplingNone;
+	float32_t sampling_spacing = 0.0f;
+	uint32_t sampling_points = 0;
+	Scene scene;
+	for(int32_t i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--backend=cpu")) backend = Simulation::BackendCPU;
+		else if(!strcmp(argv[i], "--backend=gpu")) backend = Simulation::BackendGPU;
+		else if(!strcmp(argv[i], "--deterministic")) deterministic = true;
+		else if(!strcmp(argv[i], "--adaptive")) adaptive = true;
+		else if(!strcmp(argv[i], "--levels")) num_levels = 4;
+		else if(!strcmp(argv[i], "--solver=mpm")) solver = Simulation::SolverMPM;
+		else if(!strcmp(argv[i], "--pressure=dfsph")) pressure_solver = CPUSolver::PressureDFSPH;
+		else if(!strcmp(argv[i], "--pressure=iisph")) pressure_solver = CPUSolver::PressureIISPH;
+		else if(!strncmp(argv[i], "--kernel=", 9)) kernel_name = argv[i] + 2;
+		else if(!strcmp(argv[i], "--tabulated")) pressure_parameters.tabulated = true;
+		else if(!strcmp(argv[i], "--resample=grid")) sampling = Simulation::SamplingGrid;
+		else if(!strcmp(argv[i], "--resample=poisson")) sampling = Simulation::SamplingPoisson;
+		else if(!strcmp(argv[i], "--resample=volume")) sampling = Simulation::SamplingVolume;
+		else if(!strcmp(argv[i], "-resample-spacing") && i + 1 < argc) sampling_spacing = String::tof32(argv[++i]);
+		else if(!strcmp(argv[i], "-particles") && i + 1 < argc) sampling_points = String::tou32(argv[++i]);
+		else if(!strcmp(argv[i], "-scene") && i + 1 < argc && !scene.load(argv[++i])) return 1;
+	}
+	if(kernel_name && !scene.parse(kernel_name)) return 1;
+	
 	// create window
 	String title = String::format("%s Tellusim::SpatialGrid", window.getPlatformName());
 	if(!window.create(title) || !window.setHidden(false)) return 1;
 	
 	// structures
-	struct ComputeParameters {
-		uint32_t size;
-		float32_t ifps;
-		float32_t radius;
-		uint32_t grid_size;
-		float32_t grid_scale;
-		uint32_t ranges_offset;
-	};
-	
 	struct CommonParameters {
 		Matrix4x4f projection;
 		Matrix4x4f modelview;
 		float32_t radius;
 	};
 
-	// spatial parameters
-	const uint32_t grid_size = 32;
-	const uint32_t group_size = 128;
-	constexpr float32_t radius = 0.06f;
-    float32_t ifps = 1.0f / 50.0f;
-
-    //read .las file
-    pdal::Options options;
-    pdal::LasReader reader;
+	// load particles
+	Simulation simulation;
+	Matrix4x4f transform = Matrix4x4f::translate(0.0f, 0.0f, 3.2f)  * Matrix4x4f::scale(0.03f) * Matrix4x4f::rotateZ(90.0f)  *Matrix4x4f::rotateX(80.0f) ;
+	simulation.setSampling(sampling, sampling_spacing, sampling_points);
     //pick a file to read
-    options.add("filename", "../src/models/dragon_100k.las");
-    reader.setOptions(options);
-    pdal::PointTable table;
-    reader.prepare(table);
-    pdal::PointViewSet pointViewSet = reader.execute(table);
-    pdal::PointViewPtr view = *pointViewSet.begin();
-    uint32_t num_particles = view->size();
+	if(!simulation.load(scene.getInput() ? scene.getInput().get() : "../src/models/dragon_100k.las", transform)) return 1;
+	uint32_t num_particles = simulation.getNumParticles();
+	float32_t radius = simulation.getRadius();
+	float32_t ifps = simulation.getTimeStep();
+	simulation.setPhysicsParameters(scene.getPhysics());
+	simulation.setDeterministic(deterministic);
+	simulation.setAdaptiveTimeStep(adaptive);
+	simulation.setTimeLevels(num_levels);
+	simulation.setSolver(solver);
+	simulation.setPressureSolver(pressure_solver, pressure_parameters);
 
 	// create device
 	Device device(window);
 	if(!device) return 1;
 	
-	// check compute shader support
-	if(!device.hasShader(Shader::TypeCompute)) {
-		TS_LOG(Error, "compute shader is not supported\n");
-		return 0;
-	}
-	
 	// shader cache
 	Shader::setCache("main.cache");
 	
-	// create kernel
-	Kernel kernel = device.createKernel().setUniforms(1).setStorages(9, false);
-	if(!kernel.loadShaderGLSL("../src/main.comp", "COMPUTE_SHADER=1; GROUP_SIZE=%uu", group_size)) return 1;
-	if(!kernel.create()) return 1;
-
-    // Create pressure/density kernel
-    Kernel pressureDensity = device.createKernel().setUniforms(1).setStorages(6, false);
-    if(!pressureDensity.loadShaderGLSL("../src/pressureDensity.comp", "COMPUTE_SHADER=1; GROUP_SIZE=%uu", group_size)) return 1;
-    if(!pressureDensity.create()) return 1;
+	// create simulation
+	Async async;
+	if(backend == Simulation::BackendCPU) {
+		if(!simulation.create(async)) return 1;
+		TS_LOGF(Message, "CPU backend: %u threads\n", async.getNumThreads());
+	} else {
+		if(!simulation.create(device)) return 1;
+	}
 
 	// create pipeline
 	Pipeline pipeline = device.createPipeline();
@@ -96,62 +105,17 @@ int32_t main(int32_t argc, char **argv) {
 	if(!pipeline.loadShaderGLSL(Shader::TypeFragment, "../src/main.frag", "FRAGMENT_SHADER=1")) return 1;
 	if(!pipeline.create()) return 1;
 	
-	// create particles
-	Array<Vector4f> positions(num_particles);
-	Array<Vector4f> velocities(num_particles);
-    Array<float> densities(num_particles);
-    Array<float> pressures(num_particles);
-    Array<float> masses(num_particles);
-    Array<Vector4f> interactionForces(1);
-
-	Matrix4x4f transform = Matrix4x4f::translate(0.0f, 0.0f, 3.2f)  * Matrix4x4f::scale(0.03f) * Matrix4x4f::rotateZ(90.0f)  *Matrix4x4f::rotateX(80.0f) ;
-
-    for (pdal::PointId idx = 0; idx < num_particles; ++idx) {
-        positions[idx] = transform * Vector4f(view->getFieldAs<double>(pdal::Dimension::Id::X, idx),
-                                                       view->getFieldAs<double>(pdal::Dimension::Id::Y, idx),
-                                                       view->getFieldAs<double>(pdal::Dimension::Id::Z, idx),
-                                                       1.0f);
-        velocities[idx] = Vector4f(0.0f);
-        pressures[idx] = 0.0f;
-        densities[idx] = 0.0f;
-        masses[idx] = 0.7f;
-    }
-    interactionForces[0] = Vector4f(0.0f);
-
-    // create buffers
-	Buffer position_buffers[2];
-	Buffer velocity_buffers[2];
-
-    Buffer density_buffer;
-    Buffer pressure_buffer;
-    Buffer mass_buffer;
-    Buffer interactionBuffer;
-	position_buffers[0] = device.createBuffer(Buffer::FlagVertex | Buffer::FlagStorage, positions.get(), positions.bytes());
-	position_buffers[1] = device.createBuffer(Buffer::FlagVertex | Buffer::FlagStorage, positions.bytes());
-	velocity_buffers[0] = device.createBuffer(Buffer::FlagStorage, velocities.get(), velocities.bytes());
-	velocity_buffers[1] = device.createBuffer(Buffer::FlagStorage, velocities.bytes());
-
-    density_buffer = device.createBuffer(Buffer::FlagStorage, densities.get(), densities.bytes());
-    pressure_buffer = device.createBuffer(Buffer::FlagStorage, pressures.get(), pressures.bytes());
-
-    mass_buffer = device.createBuffer(Buffer::FlagStorage, masses.get(), masses.bytes());
-    interactionBuffer = device.createBuffer(Buffer::FlagStorage, interactionForces.get(), interactionForces.bytes());
-    if(!position_buffers[0] || !position_buffers[1]) return 1;
-	if(!velocity_buffers[0] || !velocity_buffers[1]) return 1;
-	if (!mass_buffer) return 1;
-
-	// create spatial grid
-	RadixSort radix_sort;
-	PrefixScan prefix_scan;
-	SpatialGrid spatial_grid;
-	if(!radix_sort.create(device, RadixSort::ModeSingle, prefix_scan, num_particles, group_size)) return 1;
-	if(!spatial_grid.create(device, radix_sort, group_size)) return 1;
-	
-	// create spatial buffer
-	uint32_t hashes_size = num_particles * 2;
-	uint32_t ranges_size = group_size * group_size * group_size * 2;
-	auto spatial_buffer = device.createBuffer(Buffer::FlagStorage, sizeof(uint32_t) * (hashes_size + ranges_size));
-	if(!spatial_buffer || !device.clearBuffer(spatial_buffer)) return 1;
+	// render buffers for the cpu backend
+	Array<Vector4f> positions;
+	Array<Vector4f> velocities;
+	Buffer position_buffer;
+	Buffer velocity_buffer;
+	if(backend == Simulation::BackendCPU) {
+		if(!simulation.readback(positions, velocities)) return 1;
+		position_buffer = device.createBuffer(Buffer::FlagVertex | Buffer::FlagStorage, positions.get(), positions.bytes());
+		velocity_buffer = device.createBuffer(Buffer::FlagStorage, velocities.get(), velocities.bytes());
+		if(!position_buffer || !velocity_buffer) return 1;
+	}
 	
 	// create target
 	Target target = device.createTarget(window);
@@ -168,19 +132,16 @@ int32_t main(int32_t argc, char **argv) {
 		if(!window.render()) return false;
 		
 		// window title
-		if(fps > 0.0f) { window.setTitle(String::format("%s, %u particles, %.1f FPS, %.3f dt", title.get(), num_particles, fps, ifps)); }
+		if(fps > 0.0f) { window.setTitle(String::format("%s, %u particles, %.1f FPS, %.3f dt", title.get(), num_particles, fps, simulation.getTimeStep())); }
 
 		// reset simulation
 		if(window.getKeyboardKey('r')) {
-			device.setBuffer(position_buffers[0], positions.get());
-			device.setBuffer(velocity_buffers[0], velocities.get());
-            device.setBuffer(pressure_buffer, pressures.get());
-            device.setBuffer(density_buffer, densities.get());
+			if(!simulation.reset()) return false;
 			frame_counter = 0;
 		}
         // move around scene (1 and 2 = x, 3 and 4 = y, 5 and 6 = z)
-        float sens = 10.0f * ifps;
-        float moveSpeed = 1.5f * ifps;
+        float sens = 10.0f * simulation.getTimeStep();
+        float moveSpeed = 1.5f * simulation.getTimeStep();
 
         if (window.getKeyboardKey('1')) baseView *= Matrix4x4f::rotateX(-sens);
         if (window.getKeyboardKey('2')) baseView *= Matrix4x4f::rotateX(sens);
@@ -195,70 +156,28 @@ int32_t main(int32_t argc, char **argv) {
         if (window.getKeyboardKey('q')) baseView *= Matrix4x4f::translate(0.0f, 0.0f, moveSpeed);
         if (window.getKeyboardKey('e')) baseView *= Matrix4x4f::translate(0.0f, 0.0f, -moveSpeed);
         if (window.getKeyboardKey('p')) paused = !paused;
-        if (window.getKeyboardKey('.')) {
+        // the deterministic mode locks the time step
+        if (window.getKeyboardKey('.') && !simulation.isDeterministic()) {
             ifps += 0.0005;
             ifps = min (0.05f, ifps);
         }
-        if (window.getKeyboardKey(',')) {
+        if (window.getKeyboardKey(',') && !simulation.isDeterministic()) {
             ifps -= 0.0005;
             ifps = max(0.0005f, ifps);
         }
 
-        // create command list
-        Compute compute = device.createCompute();
-
-        // swap buffers
+        // simulate
         if(simulate && !paused) {
-            swap(position_buffers[0], position_buffers[1]);
-            swap(velocity_buffers[0], velocity_buffers[1]);
-        }
-
-        // compute parameters
-        ComputeParameters compute_parameters;
-        compute_parameters.size = num_particles;
-        compute_parameters.ifps = ifps;
-        compute_parameters.radius = radius;
-        compute_parameters.grid_size = grid_size;
-        compute_parameters.grid_scale = 0.25f / radius;
-        compute_parameters.ranges_offset = TS_ALIGN4(num_particles) * 2;
-
-        {
-            compute.setKernel(pressureDensity);
-            compute.setUniform(0, compute_parameters);
-            compute.setStorageBuffers(0, {
-                    spatial_buffer,
-                    position_buffers[1], velocity_buffers[1],
-                    pressure_buffer, density_buffer,
-                    mass_buffer
-            });
-            compute.dispatch(num_particles);
-            compute.barrier({spatial_buffer,
-                            position_buffers[1], velocity_buffers[1],
-                            pressure_buffer, density_buffer, mass_buffer});
+            simulation.setTimeStep(ifps);
+            if(!simulation.step()) return false;
+
+            // upload cpu state for rendering
+            if(backend == Simulation::BackendCPU) {
+                if(!simulation.readback(positions, velocities)) return false;
+                device.setBuffer(position_buffer, positions.get());
+                device.setBuffer(velocity_buffer, velocities.get());
+            }
         }
-
-        {
-			// set simulation kernel
-			compute.setKernel(kernel);
-			compute.setUniform(0, compute_parameters);
-			compute.setStorageBuffers(0, {
-                spatial_buffer,
-				position_buffers[0], velocity_buffers[0],
-				position_buffers[1], velocity_buffers[1],
-                pressure_buffer, density_buffer,
-                mass_buffer, interactionBuffer
-			});
-			compute.dispatch(num_particles);
-			compute.barrier(spatial_buffer);
-
-			// dispatch spatial grid
-			spatial_grid.dispatch(compute, spatial_buffer, 0, num_particles, 20);
-			compute.barrier({spatial_buffer,
-                             position_buffers[0], velocity_buffers[0],
-                             position_buffers[1], velocity_buffers[1],
-                             pressure_buffer, density_buffer,
-                             mass_buffer, interactionBuffer});
-		}
 		
 		// window target
 		target.setClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -278,17 +197,21 @@ int32_t main(int32_t argc, char **argv) {
             float mouseY = window.getMouseY()/100.0f - 5.0f;
 
             if (mouseX > -5.0f && mouseX < 10.0f && mouseY > -6.0f && mouseY < 6.0f)
-                interactionForces[0] = Vector4f(-mouseY, mouseX, 0.0f, 1.0f);
+                simulation.setInteraction(Vector4f(-mouseY, mouseX, 0.0f, 1.0f));
             else
-                interactionForces[0] = Vector4f(0.0f, 0.0f, 0.0f, 0.0f);
-            device.setBuffer(interactionBuffer, interactionForces.get());
+                simulation.setInteraction(Vector4f(0.0f, 0.0f, 0.0f, 0.0f));
 
 			// draw particles
 			command.setPipeline(pipeline);
 			command.setUniform(0, common_parameters);
 			command.setIndices({ 0, 1, 2, 2, 3, 0 });
-			command.setVertexBuffer(0, position_buffers[0]);
-            command.setStorageBuffer(0, velocity_buffers[0]);
+			if(backend == Simulation::BackendCPU) {
+				command.setVertexBuffer(0, position_buffer);
+				command.setStorageBuffer(0, velocity_buffer);
+			} else {
+				command.setVertexBuffer(0, simulation.getPositionBuffer());
+				command.setStorageBuffer(0, simulation.getVelocityBuffer());
+			}
 			command.drawElementsInstanced(6, 0, num_particles);
 		}
 		target.end();